@@ -4,3 +4,7 @@
 #define VERSION_MINOR		1
 
 #define KEY_FIFO_SIZE		31       // number of keys in the public FIFO
+
+#ifndef USB_MOUSE_POLL_MS
+#define USB_MOUSE_POLL_MS	10       // default mouse endpoint polling interval, 1 for 1000 Hz reports
+#endif
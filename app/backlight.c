@@ -1,22 +1,315 @@
 #include "backlight.h"
+
+#include "events.h"
+#include "gesture.h"
+#include "keyboard.h"
+#include "power.h"
 #include "reg.h"
 
 #include <hardware/pwm.h>
+#include <hardware/sync.h>
 #include <pico/stdlib.h>
 
+#define FADE_TICK_MS			4
+#define FADE_TIME_UNIT_MS		10	// REG_BFT units
+#define MAX_PWM_LEVEL			(255 * 0x80) // duty at full brightness out of 0x10000, the LEDs have never been driven harder than this
+#define PWM_FREQ_HZ				1907 // what the default PWM config gives at 125 MHz
+
+// brightness levels are Q8, so a fade keeps moving even when it's slower than one register step per tick
+#define LEVEL(value)			((uint16_t)(value) << 8)
+
+struct channel_def
+{
+	enum reg_id reg;
+	uint pin;
+};
+
+// the secondary backlight only exists on boards that give it a pin, otherwise REG_BK2 is just stored
+static const struct channel_def channel_defs[] =
+{
+	{ REG_ID_BKL, PIN_BKL },
+#ifdef PIN_BKL2
+	{ REG_ID_BK2, PIN_BKL2 },
+#endif
+};
+#define NUM_OF_CHANNELS			(sizeof(channel_defs) / sizeof(channel_defs[0]))
+
+// brightness register value to PWM duty with a gamma of 2.2, out of MAX_PWM_LEVEL, generated with
+//   python3 -c "print([int((i / 255) ** 2.2 * 255 * 0x80 + 0.5) for i in range(256)])"
+static const uint16_t gamma_table[256] =
+{
+	    0,     0,     1,     2,     3,     6,     9,    12,    16,    21,    26,    32,    39,    47,    55,    64,
+	   74,    84,    96,   108,   121,   134,   149,   164,   180,   197,   215,   234,   253,   273,   294,   316,
+	  339,   363,   388,   413,   440,   467,   495,   524,   554,   585,   617,   650,   684,   719,   754,   791,
+	  828,   867,   906,   946,   988,  1030,  1073,  1117,  1162,  1209,  1256,  1304,  1353,  1403,  1454,  1506,
+	 1559,  1614,  1669,  1725,  1782,  1840,  1899,  1959,  2021,  2083,  2146,  2211,  2276,  2342,  2410,  2478,
+	 2548,  2618,  2690,  2763,  2836,  2911,  2987,  3064,  3142,  3221,  3301,  3383,  3465,  3548,  3633,  3718,
+	 3805,  3893,  3982,  4072,  4163,  4255,  4348,  4442,  4538,  4634,  4732,  4831,  4931,  5032,  5134,  5237,
+	 5341,  5447,  5553,  5661,  5770,  5880,  5991,  6103,  6217,  6331,  6447,  6564,  6682,  6801,  6921,  7043,
+	 7165,  7289,  7414,  7540,  7667,  7795,  7925,  8056,  8187,  8320,  8455,  8590,  8727,  8864,  9003,  9143,
+	 9285,  9427,  9571,  9715,  9861, 10009, 10157, 10306, 10457, 10609, 10762, 10917, 11072, 11229, 11387, 11546,
+	11706, 11868, 12031, 12195, 12360, 12526, 12694, 12863, 13033, 13204, 13377, 13550, 13725, 13902, 14079, 14258,
+	14437, 14619, 14801, 14984, 15169, 15355, 15542, 15731, 15921, 16112, 16304, 16497, 16692, 16888, 17085, 17284,
+	17483, 17684, 17887, 18090, 18295, 18501, 18708, 18916, 19126, 19337, 19549, 19763, 19978, 20194, 20411, 20630,
+	20850, 21071, 21293, 21517, 21742, 21968, 22196, 22425, 22655, 22886, 23119, 23353, 23588, 23825, 24062, 24301,
+	24542, 24784, 25027, 25271, 25516, 25763, 26011, 26261, 26512, 26764, 27017, 27272, 27528, 27785, 28043, 28303,
+	28564, 28827, 29091, 29356, 29622, 29890, 30159, 30430, 30701, 30974, 31249, 31524, 31801, 32079, 32359, 32640,
+};
+
+struct channel
+{
+	uint16_t level;
+	uint16_t from;
+	uint16_t to;
+	uint32_t start_time;
+	uint32_t fade_time;
+};
+
+static struct
+{
+	struct channel channels[NUM_OF_CHANNELS];
+	bool fade_running;
+
+	uint32_t wrap;
+
+	uint32_t last_activity_time;
+	alarm_id_t idle_alarm;
+	bool idle;
+
+	bool dormant;
+} self;
+
+static void output(uint8_t idx)
+{
+	const uint16_t level = self.channels[idx].level;
+	uint32_t duty;
+
+	if (reg_is_bit_set(REG_ID_BCF, BCF_GAMMA_ON)) {
+		// interpolate between the table entries with the fraction of the level
+		const uint8_t i = (level >> 8);
+		const uint32_t a = gamma_table[i];
+		const uint32_t b = gamma_table[MIN(i + 1, 255)];
+
+		duty = a + (((b - a) * (level & 0xFF)) >> 8);
+	} else {
+		duty = ((uint32_t)level * MAX_PWM_LEVEL) / LEVEL(255);
+	}
+
+	// the compare register is double buffered and only taken over when the counter wraps, so no glitches mid-period
+	pwm_set_gpio_level(channel_defs[idx].pin, (duty * (self.wrap + 1)) >> 16);
+}
+
+static uint16_t target_level(uint8_t idx)
+{
+	uint8_t value = reg_get_value(channel_defs[idx].reg);
+
+	if (self.idle)
+		value = MIN(value, reg_get_value(REG_ID_BIL));
+
+	return LEVEL(value);
+}
+
+static int64_t fade_task(alarm_id_t id, void *user_data)
+{
+	(void)id;
+	(void)user_data;
+
+	const uint32_t now = to_ms_since_boot(get_absolute_time());
+	bool running = false;
+
+	for (uint8_t i = 0; i < NUM_OF_CHANNELS; ++i) {
+		struct channel *channel = &self.channels[i];
+
+		if (channel->level == channel->to)
+			continue;
+
+		const uint32_t elapsed = now - channel->start_time;
+
+		if (elapsed >= channel->fade_time) {
+			channel->level = channel->to;
+		} else {
+			const int32_t delta = (int32_t)channel->to - (int32_t)channel->from;
+			channel->level = channel->from + ((delta * (int32_t)elapsed) / (int32_t)channel->fade_time);
+			running = true;
+		}
+
+		output(i);
+	}
+
+	self.fade_running = running;
+	if (!running)
+		return 0;
+
+	// negative value means interval since last alarm time
+	return -(FADE_TICK_MS * 1000);
+}
+
+static void fade_to_targets(void)
+{
+	const uint32_t now = to_ms_since_boot(get_absolute_time());
+	const uint32_t fade_time = reg_get_value(REG_ID_BFT) * FADE_TIME_UNIT_MS;
+	bool fading = false;
+
+	// called from the main loop as well, the fade alarm must not step the channels halfway through
+	const uint32_t irq = save_and_disable_interrupts();
+
+	for (uint8_t i = 0; i < NUM_OF_CHANNELS; ++i) {
+		struct channel *channel = &self.channels[i];
+
+		channel->from = channel->level;
+		channel->to = target_level(i);
+		channel->start_time = now;
+		channel->fade_time = fade_time;
+
+		if (fade_time == 0) {
+			channel->level = channel->to;
+			output(i);
+		} else if (channel->level != channel->to) {
+			fading = true;
+		}
+	}
+
+	if (fading && !self.fade_running)
+		self.fade_running = (add_alarm_in_ms(FADE_TICK_MS, fade_task, NULL, true) > 0);
+
+	restore_interrupts(irq);
+}
+
+static int64_t idle_task(alarm_id_t id, void *user_data)
+{
+	(void)id;
+	(void)user_data;
+
+	const uint32_t timeout = reg_get_value(REG_ID_BIT) * 1000;
+	const uint32_t idle = to_ms_since_boot(get_absolute_time()) - self.last_activity_time;
+
+	if (timeout && (idle < timeout))
+		return (int64_t)(timeout - idle) * 1000;
+
+	self.idle_alarm = 0;
+
+	if (timeout) {
+		self.idle = true;
+		fade_to_targets();
+	}
+
+	return 0;
+}
+
+static void restart_idle_timer(void)
+{
+	if (self.idle_alarm)
+		cancel_alarm(self.idle_alarm);
+
+	self.idle_alarm = 0;
+
+	const uint32_t timeout = reg_get_value(REG_ID_BIT) * 1000;
+	if (!timeout || self.idle)
+		return;
+
+	const uint32_t idle = to_ms_since_boot(get_absolute_time()) - self.last_activity_time;
+	const alarm_id_t alarm = add_alarm_in_ms((idle < timeout) ? (timeout - idle) : 1, idle_task, NULL, true);
+
+	self.idle_alarm = MAX(alarm, 0);
+}
+
+static void activity(uint8_t wake_bit)
+{
+	if (!reg_is_bit_set(REG_ID_BCF, wake_bit))
+		return;
+
+	self.last_activity_time = to_ms_since_boot(get_absolute_time());
+
+	if (self.idle) {
+		self.idle = false;
+		fade_to_targets();
+	}
+
+	// while the alarm is pending it pushes itself out to the last activity
+	if (!self.idle_alarm)
+		restart_idle_timer();
+}
+
+void backlight_key_cb(char key, enum key_state state)
+{
+	(void)key;
+	(void)state;
+
+	activity(BCF_KEY_WAKE);
+}
+
+void backlight_touch_cb(int8_t x, int8_t y)
+{
+	(void)x;
+	(void)y;
+
+	activity(BCF_TOUCH_WAKE);
+}
+
+void backlight_gesture_cb(enum gesture gesture, int8_t x, int8_t y)
+{
+	(void)gesture;
+	(void)x;
+	(void)y;
+
+	activity(BCF_TOUCH_WAKE);
+}
+
+// the PWM stops wherever it was when the clocks stop, so hold the pins low instead
+void backlight_power_cb(enum power_state state)
+{
+	if ((state == POWER_DORMANT) == self.dormant)
+		return;
+
+	self.dormant = (state == POWER_DORMANT);
+
+	for (uint8_t i = 0; i < NUM_OF_CHANNELS; ++i) {
+		if (self.dormant) {
+			gpio_put(channel_defs[i].pin, 0);
+			gpio_set_dir(channel_defs[i].pin, GPIO_OUT);
+			gpio_set_function(channel_defs[i].pin, GPIO_FUNC_SIO);
+		} else {
+			gpio_set_function(channel_defs[i].pin, GPIO_FUNC_PWM);
+		}
+	}
+}
+
+// a lower system clock gets a shorter period instead of a lower PWM frequency
+void backlight_clock_cb(uint32_t sys_hz)
+{
+	self.wrap = MIN(sys_hz / PWM_FREQ_HZ, 0x10000) - 1;
+
+	for (uint8_t i = 0; i < NUM_OF_CHANNELS; ++i) {
+		pwm_set_wrap(pwm_gpio_to_slice_num(channel_defs[i].pin), self.wrap);
+		output(i);
+	}
+}
+
 void backlight_sync(void)
 {
-	pwm_set_gpio_level(PIN_BKL, reg_get_value(REG_ID_BKL)  * 0x80);
+	// a changed timeout counts from the last activity, a disabled one brings the backlight back
+	if (!reg_get_value(REG_ID_BIT))
+		self.idle = false;
+
+	restart_idle_timer();
+
+	fade_to_targets();
 }
 
 void backlight_init(void)
 {
-	gpio_set_function(PIN_BKL, GPIO_FUNC_PWM);
+	for (uint8_t i = 0; i < NUM_OF_CHANNELS; ++i) {
+		gpio_set_function(channel_defs[i].pin, GPIO_FUNC_PWM);
+
+		const uint slice_num = pwm_gpio_to_slice_num(channel_defs[i].pin);
+
+		pwm_config config = pwm_get_default_config();
+		pwm_init(slice_num, &config, true);
+	}
 
-	const uint slice_num = pwm_gpio_to_slice_num(PIN_BKL);
+	self.wrap = 0xFFFF;
 
-	pwm_config config = pwm_get_default_config();
-	pwm_init(slice_num, &config, true);
+	self.last_activity_time = to_ms_since_boot(get_absolute_time());
 
 	backlight_sync();
 }
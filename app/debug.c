@@ -1,106 +1,158 @@
 #include "debug.h"
 
 #include "app_config.h"
+#include "events.h"
+#include "gesture.h"
 #include "gpioexp.h"
 #include "keyboard.h"
 #include "reg.h"
-#include "touchpad.h"
 #include "usb.h"
 
-#include <pico/mutex.h>
 #include <pico/stdio/driver.h>
 #include <pico/stdlib.h>
 #include <stdio.h>
 #include <tusb.h>
 
-#define PICO_STDIO_USB_STDOUT_TIMEOUT_US 500000
+#if LIB_PICO_STDIO_UART
+#include <hardware/uart.h>
+#include <pico/stdio_uart.h>
+#endif
+
+#define LOG_BUFFER_SIZE		2048 // must be a power of 2
 
-static void key_cb(char key, enum key_state state)
+static struct
+{
+	char buffer[LOG_BUFFER_SIZE];
+	volatile uint32_t head;	// free running write index
+	volatile uint32_t tail;	// free running read index
+	uint32_t dropped_bytes;
+	uint32_t dropped_writes;
+} self;
+
+void debug_key_cb(char key, enum key_state state)
 {
 	printf("key: 0x%02X/%d/%c, state: %d\r\n", key, key, key, state);
 }
-static struct key_callback key_callback = { .func = key_cb };
 
-static void key_lock_cb(bool caps_changed, bool num_changed)
+void debug_key_lock_cb(bool caps_changed, bool num_changed)
 {
 	printf("lock, caps_c: %d, caps: %d, num_c: %d, num: %d\r\n",
 		   caps_changed, keyboard_get_capslock(),
 		   num_changed, keyboard_get_numlock());
 }
-static struct key_lock_callback key_lock_callback ={ .func = key_lock_cb };
 
-static void touch_cb(int8_t x, int8_t y)
+void debug_touch_cb(int8_t x, int8_t y)
 {
 	printf("%s: x: %d, y: %d !\r\n", __func__, x, y);
 }
-static struct touch_callback touch_callback = { .func = touch_cb };
 
-static void gpioexp_cb(uint8_t gpio, uint8_t gpio_idx)
+void debug_gesture_cb(enum gesture gesture, int8_t x, int8_t y)
 {
-	printf("gpioexp, pin: %d, idx: %d\r\n", gpio, gpio_idx);
+	printf("%s: gesture: %d, x: %d, y: %d\r\n", __func__, gesture, x, y);
 }
-static struct gpioexp_callback gpioexp_callback = { .func = gpioexp_cb };
 
-// copied from pico_stdio_usb in the SDK
-static void usb_out_chars(const char *buf, int length)
+void debug_gpioexp_cb(uint8_t gpio, uint8_t gpio_idx, bool level)
 {
-	static uint64_t last_avail_time;
-	uint32_t owner;
+	printf("gpioexp, pin: %d, idx: %d, level: %d\r\n", gpio, gpio_idx, level);
+}
 
-	if (!mutex_try_enter(usb_get_mutex(), &owner)) {
-		if (owner == get_core_num())
-			return;
+// The log only ever lands in the ring buffer, which is O(1) and never waits on the host. The USB worker
+// drains it to the CDC port, or to the UART while no terminal has the port open, so every write requests a run.
+static void log_out_chars(const char *buf, int length)
+{
+	const uint32_t irq = save_and_disable_interrupts();
 
-		mutex_enter_blocking(usb_get_mutex());
+	const uint32_t space = LOG_BUFFER_SIZE - (self.head - self.tail);
+	if ((uint32_t)length > space) {
+		self.dropped_bytes += length - space;
+		++self.dropped_writes;
+		length = space;
 	}
 
-	if (tud_cdc_connected()) {
-		for (int i = 0; i < length;) {
-			int n = length - i;
-			int avail = tud_cdc_write_available();
-			if (n > avail) n = avail;
-			if (n) {
-				int n2 = tud_cdc_write(buf + i, n);
-				tud_task();
-				tud_cdc_write_flush();
-				i += n2;
-				last_avail_time = time_us_64();
-			} else {
-				tud_task();
-				tud_cdc_write_flush();
-				if (!tud_cdc_connected() ||
-					(!tud_cdc_write_available() && time_us_64() > last_avail_time + PICO_STDIO_USB_STDOUT_TIMEOUT_US)) {
-					break;
-				}
-			}
-		}
-	} else {
-		// reset our timeout
-		last_avail_time = 0;
-	}
+	// the buffer size is a power of 2, so the indexes just wrap around
+	const uint32_t idx = self.head % LOG_BUFFER_SIZE;
+	const uint32_t first = MIN((uint32_t)length, LOG_BUFFER_SIZE - idx);
+
+	memcpy(&self.buffer[idx], buf, first);
+	memcpy(self.buffer, buf + first, length - first);
+
+	self.head += length;
 
-	mutex_exit(usb_get_mutex());
+	restore_interrupts(irq);
+
+	usb_request_task();
 }
-static struct stdio_driver stdio_usb =
+static struct stdio_driver stdio_log =
 {
-	.out_chars = usb_out_chars,
+	.out_chars = log_out_chars,
 #if PICO_STDIO_ENABLE_CRLF_SUPPORT
 	.crlf_enabled = PICO_STDIO_DEFAULT_CRLF
 #endif
 };
 
-void debug_init(void)
+static uint32_t write_sink(const char *buf, uint32_t length)
 {
-	stdio_init_all();
+	if (tud_cdc_connected())
+		return tud_cdc_write(buf, length);
+
+#if LIB_PICO_STDIO_UART
+	uint32_t written = 0;
+	while ((written < length) && uart_is_writable(uart_default))
+		uart_putc_raw(uart_default, buf[written++]);
+
+	return written;
+#else
+	// nobody's listening, throw it away
+	return length;
+#endif
+}
+
+static void drain(void)
+{
+	while (self.head != self.tail) {
+		// only the producers move head, and this is the only consumer
+		const uint32_t idx = self.tail % LOG_BUFFER_SIZE;
+		const uint32_t len = MIN(self.head - self.tail, LOG_BUFFER_SIZE - idx);
 
-	stdio_set_driver_enabled(&stdio_usb, true);
+		const uint32_t written = write_sink(&self.buffer[idx], len);
+		self.tail += written;
 
-	printf("I2C Puppet SW v%d.%d\r\n", VERSION_MAJOR, VERSION_MINOR);
+		if (written < len)
+			break;
+	}
+}
+
+void debug_flush(void)
+{
+	drain();
+
+	// report losses once everything before them is out, so the note ends up where the gap is
+	if ((self.head == self.tail) && self.dropped_writes) {
+		char note[48];
+		const int len = snprintf(note, sizeof(note), "\r\n[log: %lu bytes in %lu writes dropped]\r\n",
+								 (unsigned long)self.dropped_bytes, (unsigned long)self.dropped_writes);
+
+		self.dropped_bytes = 0;
+		self.dropped_writes = 0;
+
+		log_out_chars(note, MIN(len, (int)sizeof(note) - 1));
+		drain();
+	}
 
-	keyboard_add_key_callback(&key_callback);
-	keyboard_add_lock_callback(&key_lock_callback);
+	if (tud_cdc_connected())
+		tud_cdc_write_flush();
+}
+
+void debug_init(void)
+{
+	stdio_init_all();
+
+#if LIB_PICO_STDIO_UART
+	// the UART driver blocks until the bytes are out, the log buffer is drained to the UART instead
+	stdio_set_driver_enabled(&stdio_uart, false);
+#endif
 
-	touchpad_add_touch_callback(&touch_callback);
+	stdio_set_driver_enabled(&stdio_log, true);
 
-	gpioexp_add_int_callback(&gpioexp_callback);
+	printf("I2C Puppet SW v%d.%d\r\n", VERSION_MAJOR, VERSION_MINOR);
 }
@@ -1,3 +1,6 @@
 #pragma once
 
 void debug_init(void);
+
+// called from the USB worker, writes out whatever was logged since the last call
+void debug_flush(void);
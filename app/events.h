@@ -0,0 +1,120 @@
+#pragma once
+
+#include "gesture.h"
+#include "keyboard.h"
+#include "power.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Every event with its subscribers, called in the order they are listed here. The table is fixed at build time,
+// so raising an event is a row of direct calls, and the debug subscribers don't exist in release builds.
+// The subscribers run in the main loop, see work.h.
+
+// a key changed state
+void usb_key_cb(char key, enum key_state state);
+void debug_key_cb(char key, enum key_state state);
+void backlight_key_cb(char key, enum key_state state);
+void interrupt_key_cb(char key, enum key_state state);
+void power_key_cb(char key, enum key_state state);
+
+static inline void events_key(char key, enum key_state state)
+{
+	usb_key_cb(key, state);
+#ifndef NDEBUG
+	debug_key_cb(key, state);
+#endif
+	backlight_key_cb(key, state);
+	interrupt_key_cb(key, state);
+	power_key_cb(key, state);
+}
+
+// caps lock or num lock toggled
+void usb_key_lock_cb(bool caps_changed, bool num_changed);
+void debug_key_lock_cb(bool caps_changed, bool num_changed);
+void interrupt_key_lock_cb(bool caps_changed, bool num_changed);
+
+static inline void events_key_lock(bool caps_changed, bool num_changed)
+{
+	usb_key_lock_cb(caps_changed, num_changed);
+#ifndef NDEBUG
+	debug_key_lock_cb(caps_changed, num_changed);
+#endif
+	interrupt_key_lock_cb(caps_changed, num_changed);
+}
+
+// pointer motion, after the gestures and the pointer processing had their go at it
+void usb_touch_cb(int8_t x, int8_t y);
+void debug_touch_cb(int8_t x, int8_t y);
+void reg_touch_cb(int8_t x, int8_t y);
+void backlight_touch_cb(int8_t x, int8_t y);
+void interrupt_touch_cb(int8_t x, int8_t y);
+void power_touch_cb(int8_t x, int8_t y);
+
+static inline void events_touch(int8_t x, int8_t y)
+{
+	usb_touch_cb(x, y);
+#ifndef NDEBUG
+	debug_touch_cb(x, y);
+#endif
+	reg_touch_cb(x, y);
+	backlight_touch_cb(x, y);
+	interrupt_touch_cb(x, y);
+	power_touch_cb(x, y);
+}
+
+// for GESTURE_SCROLL x and y are the pan and wheel in 1/GESTURE_SCROLL_RES steps, 0 otherwise
+void usb_gesture_cb(enum gesture gesture, int8_t x, int8_t y);
+void debug_gesture_cb(enum gesture gesture, int8_t x, int8_t y);
+void reg_gesture_cb(enum gesture gesture, int8_t x, int8_t y);
+void backlight_gesture_cb(enum gesture gesture, int8_t x, int8_t y);
+void interrupt_gesture_cb(enum gesture gesture, int8_t x, int8_t y);
+void power_gesture_cb(enum gesture gesture, int8_t x, int8_t y);
+
+static inline void events_gesture(enum gesture gesture, int8_t x, int8_t y)
+{
+	usb_gesture_cb(gesture, x, y);
+#ifndef NDEBUG
+	debug_gesture_cb(gesture, x, y);
+#endif
+	reg_gesture_cb(gesture, x, y);
+	backlight_gesture_cb(gesture, x, y);
+	interrupt_gesture_cb(gesture, x, y);
+	power_gesture_cb(gesture, x, y);
+}
+
+// a GPIO expander input had an edge, level is what the pin was at the last one
+void usb_gpioexp_cb(uint8_t gpio, uint8_t gpio_idx, bool level);
+void debug_gpioexp_cb(uint8_t gpio, uint8_t gpio_idx, bool level);
+void interrupt_gpioexp_cb(uint8_t gpio, uint8_t gpio_idx, bool level);
+
+static inline void events_gpioexp(uint8_t gpio, uint8_t gpio_idx, bool level)
+{
+	usb_gpioexp_cb(gpio, gpio_idx, level);
+#ifndef NDEBUG
+	debug_gpioexp_cb(gpio, gpio_idx, level);
+#endif
+	interrupt_gpioexp_cb(gpio, gpio_idx, level);
+}
+
+// the power state changed
+void backlight_power_cb(enum power_state state);
+void keyboard_power_cb(enum power_state state);
+
+static inline void events_power(enum power_state state)
+{
+	backlight_power_cb(state);
+	keyboard_power_cb(state);
+}
+
+// clk_sys changed, redo whatever was derived from it
+void backlight_clock_cb(uint32_t sys_hz);
+void gpioexp_clock_cb(uint32_t sys_hz);
+void touchpad_clock_cb(uint32_t sys_hz);
+
+static inline void events_clock(uint32_t sys_hz)
+{
+	backlight_clock_cb(sys_hz);
+	gpioexp_clock_cb(sys_hz);
+	touchpad_clock_cb(sys_hz);
+}
@@ -1,5 +1,6 @@
 #include "app_config.h"
 #include "fifo.h"
+#include "trace.h"
 
 static struct
 {
@@ -31,6 +32,8 @@ bool fifo_enqueue(const struct fifo_item item)
 	self.write_idx %= KEY_FIFO_SIZE;
 	++self.count;
 
+	trace(TRACE_FIFO_PUSH, item.key, item.state);
+
 	return true;
 }
 
@@ -44,17 +47,23 @@ void fifo_enqueue_force(const struct fifo_item item)
 
 	self.read_idx++;
 	self.read_idx %= KEY_FIFO_SIZE;
+
+	trace(TRACE_FIFO_PUSH, item.key, item.state);
 }
 
 struct fifo_item fifo_dequeue(void)
 {
 	struct fifo_item item = { 0 };
-	if (self.count == 0)
+	if (self.count == 0) {
+		trace(TRACE_FIFO_POP, 0, 0);
 		return item;
+	}
 
 	item = self.fifo[self.read_idx++];
 	self.read_idx %= KEY_FIFO_SIZE;
 	--self.count;
 
+	trace(TRACE_FIFO_POP, item.key, item.state);
+
 	return item;
 }
@@ -0,0 +1,255 @@
+#include "gesture.h"
+
+#include "events.h"
+#include "keyboard.h"
+#include "reg.h"
+#include "work.h"
+
+#include <pico/stdlib.h>
+#include <stdlib.h>
+
+#define SWIPE_COOLDOWN_TIME_MS	100 // time to wait before generating a new swipe event
+#define SWIPE_RELEASE_DELAY_MS	10  // time to wait before sending key release event
+#define MOTION_IS_SWIPE(i, j)	((abs(i) >= reg_get_value(REG_ID_SWT)) && (abs(j) <= reg_get_value(REG_ID_SWO)))
+
+#define SESSION_GAP_MS			30  // no motion for this long ends the current touch session
+#define TAP_MAX_TIME_MS			150 // longest session that still counts as a tap
+#define TAP_MAX_DISTANCE		6   // most travel (|x| + |y|) that still counts as a tap
+
+#define SCROLL_DIVISOR			8   // touch counts per wheel/pan step
+#define INERTIA_TICK_MS			16
+#define INERTIA_MIN_VELOCITY	32  // below this (Q8 counts per tick) the coasting stops
+
+enum session_mode
+{
+	SESSION_NONE = 0,
+	SESSION_POINTER,
+	SESSION_SCROLL,
+	SESSION_SWIPE,
+};
+
+static struct
+{
+	enum session_mode mode;
+	uint32_t session_start_time;
+	uint32_t last_motion_time;
+	uint16_t session_distance;
+	bool session_alarm_pending;
+
+	uint32_t last_swipe_time;
+
+	// scroll motion not yet turned into whole steps, and its velocity for the inertia, both Q8
+	int32_t scroll_acc_x;
+	int32_t scroll_acc_y;
+	int32_t velocity_x;
+	int32_t velocity_y;
+	bool inertia_running;
+} self;
+
+static void scroll_step(void)
+{
+	const int32_t step = (SCROLL_DIVISOR << 8) / GESTURE_SCROLL_RES;
+	const int32_t pan = self.scroll_acc_x / step;
+	const int32_t wheel = self.scroll_acc_y / step;
+
+	if (!pan && !wheel)
+		return;
+
+	self.scroll_acc_x -= pan * step;
+	self.scroll_acc_y -= wheel * step;
+
+	// touch y grows downwards, the wheel grows upwards
+	events_gesture(GESTURE_SCROLL, MAX(INT8_MIN, MIN(pan, INT8_MAX)), MAX(INT8_MIN, MIN(-wheel, INT8_MAX)));
+}
+
+static void inertia_work(uint32_t arg)
+{
+	(void)arg;
+
+	if (!self.inertia_running)
+		return;
+
+	self.scroll_acc_x += self.velocity_x;
+	self.scroll_acc_y += self.velocity_y;
+	scroll_step();
+
+	self.velocity_x -= self.velocity_x / 16;
+	self.velocity_y -= self.velocity_y / 16;
+
+	// the alarm stops on its next tick
+	if ((abs(self.velocity_x) < INERTIA_MIN_VELOCITY) && (abs(self.velocity_y) < INERTIA_MIN_VELOCITY))
+		self.inertia_running = false;
+}
+
+static int64_t inertia_task(alarm_id_t id, void *user_data)
+{
+	(void)id;
+	(void)user_data;
+
+	if (!self.inertia_running)
+		return 0;
+
+	// the scroll steps go out through the callbacks, those run in the main loop
+	work_post(WORK_PRIO_NORMAL, inertia_work, 0);
+
+	// negative value means interval since last alarm time
+	return -(INERTIA_TICK_MS * 1000);
+}
+
+static int64_t session_task(alarm_id_t id, void *user_data);
+
+static void session_end_work(uint32_t arg)
+{
+	(void)arg;
+
+	// motion came in after the alarm went off, the session goes on
+	const uint32_t idle = to_ms_since_boot(get_absolute_time()) - self.last_motion_time;
+	if (idle < SESSION_GAP_MS) {
+		self.session_alarm_pending = (add_alarm_in_ms(SESSION_GAP_MS - idle, session_task, NULL, true) > 0);
+		return;
+	}
+
+	self.session_alarm_pending = false;
+
+	switch (self.mode) {
+	case SESSION_POINTER:
+		if (reg_is_bit_set(REG_ID_GCF, GCF_TAP_ON) &&
+			((self.last_motion_time - self.session_start_time) <= TAP_MAX_TIME_MS) &&
+			(self.session_distance <= TAP_MAX_DISTANCE)) {
+			events_gesture(GESTURE_TAP, 0, 0);
+		}
+		break;
+
+	case SESSION_SCROLL:
+		if (reg_is_bit_set(REG_ID_GCF, GCF_INERTIA_ON) &&
+			((abs(self.velocity_x) >= INERTIA_MIN_VELOCITY) || (abs(self.velocity_y) >= INERTIA_MIN_VELOCITY))) {
+			self.inertia_running = true;
+			add_alarm_in_ms(INERTIA_TICK_MS, inertia_task, NULL, true);
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	self.mode = SESSION_NONE;
+}
+
+static int64_t session_task(alarm_id_t id, void *user_data)
+{
+	(void)id;
+	(void)user_data;
+
+	const uint32_t idle = to_ms_since_boot(get_absolute_time()) - self.last_motion_time;
+	if (idle < SESSION_GAP_MS)
+		return -(int64_t)(SESSION_GAP_MS - idle) * 1000;
+
+	// the session stays pending until the main loop ended it, try again if the queue was full
+	if (!work_post(WORK_PRIO_NORMAL, session_end_work, 0))
+		return SESSION_GAP_MS * 1000;
+
+	return 0;
+}
+
+static void release_key_work(uint32_t arg)
+{
+	keyboard_inject_event((char)arg, KEY_STATE_RELEASED);
+}
+
+static int64_t release_key(alarm_id_t id, void *user_data)
+{
+	(void)id;
+
+	const char key = (char)(uintptr_t)user_data;
+
+	// the release goes through the same callbacks as the press, in the main loop
+	if (!work_post(WORK_PRIO_NORMAL, release_key_work, (uint32_t)key))
+		return SWIPE_RELEASE_DELAY_MS * 1000;
+
+	return 0;
+}
+
+static void process_swipe(int8_t x, int8_t y, uint32_t now)
+{
+	if (now - self.last_swipe_time <= SWIPE_COOLDOWN_TIME_MS)
+		return;
+
+	enum gesture gesture = GESTURE_NONE;
+	char key = '\0';
+
+	if (MOTION_IS_SWIPE(y, x)) {
+		gesture = (y < 0) ? GESTURE_SWIPE_UP : GESTURE_SWIPE_DOWN;
+		key = (y < 0) ? KEY_JOY_UP : KEY_JOY_DOWN;
+	} else if (MOTION_IS_SWIPE(x, y)) {
+		gesture = (x < 0) ? GESTURE_SWIPE_LEFT : GESTURE_SWIPE_RIGHT;
+		key = (x < 0) ? KEY_JOY_LEFT : KEY_JOY_RIGHT;
+	}
+
+	if (gesture == GESTURE_NONE)
+		return;
+
+	keyboard_inject_event(key, KEY_STATE_PRESSED);
+
+	// we need to allow the usb a bit of time to send the press, so schedule the release after a bit
+	add_alarm_in_ms(SWIPE_RELEASE_DELAY_MS, release_key, (void *)(uintptr_t)key, true);
+
+	self.last_swipe_time = now;
+
+	events_gesture(gesture, 0, 0);
+}
+
+static void process_scroll(int8_t x, int8_t y, uint32_t dt)
+{
+	self.scroll_acc_x += (x * 256);
+	self.scroll_acc_y += (y * 256);
+	scroll_step();
+
+	// velocity in Q8 counts per inertia tick, lightly averaged to ignore the odd jittery report
+	dt = MAX(1, MIN(dt, SESSION_GAP_MS));
+	self.velocity_x = (self.velocity_x + ((x * 256) * INERTIA_TICK_MS / (int32_t)dt)) / 2;
+	self.velocity_y = (self.velocity_y + ((y * 256) * INERTIA_TICK_MS / (int32_t)dt)) / 2;
+}
+
+bool gesture_process_motion(int8_t x, int8_t y)
+{
+	const uint32_t now = to_ms_since_boot(get_absolute_time());
+	const uint32_t dt = now - self.last_motion_time;
+
+	// a finger on the sensor stops any coasting scroll
+	self.inertia_running = false;
+
+	enum session_mode mode = SESSION_POINTER;
+	if (keyboard_is_mod_on(KEY_MOD_ID_ALT) && reg_is_bit_set(REG_ID_GCF, GCF_SWIPE_ON))
+		mode = SESSION_SWIPE;
+	else if (keyboard_is_mod_on(KEY_MOD_ID_SYM) && reg_is_bit_set(REG_ID_GCF, GCF_SCROLL_ON))
+		mode = SESSION_SCROLL;
+
+	if (mode != self.mode) {
+		self.mode = mode;
+		self.session_start_time = now;
+		self.session_distance = 0;
+		self.scroll_acc_x = 0;
+		self.scroll_acc_y = 0;
+		self.velocity_x = 0;
+		self.velocity_y = 0;
+	}
+
+	self.session_distance = MIN(UINT16_MAX, self.session_distance + abs(x) + abs(y));
+	self.last_motion_time = now;
+
+	if (!self.session_alarm_pending)
+		self.session_alarm_pending = (add_alarm_in_ms(SESSION_GAP_MS, session_task, NULL, true) > 0);
+
+	switch (mode) {
+	case SESSION_SWIPE:
+		process_swipe(x, y, now);
+		return true;
+
+	case SESSION_SCROLL:
+		process_scroll(x, y, dt);
+		return true;
+
+	default:
+		return false;
+	}
+}
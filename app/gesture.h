@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define GESTURE_SCROLL_RES		8 // GESTURE_SCROLL units per wheel/pan step
+
+enum gesture
+{
+	GESTURE_NONE = 0,
+	GESTURE_TAP,
+	GESTURE_SWIPE_UP,
+	GESTURE_SWIPE_DOWN,
+	GESTURE_SWIPE_LEFT,
+	GESTURE_SWIPE_RIGHT,
+	GESTURE_SCROLL,
+};
+
+// returns true if the motion was consumed and should not be reported as pointer motion
+bool gesture_process_motion(int8_t x, int8_t y);
@@ -1,93 +1,604 @@
 #include "gpioexp.h"
+#include "events.h"
 #include "reg.h"
+#include "work.h"
 
+#include <hardware/clocks.h>
+#include <hardware/irq.h>
+#include <hardware/pwm.h>
+#include <hardware/sync.h>
 #include <pico/stdlib.h>
 #include <stdio.h>
 
+#define GPIOEXP_IRQ_EDGES		(GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE)
+#define EVENT_QUEUE_SIZE		32
+
+#define PWM_MAX_WRAP			0xFFFF
+#define PWM_MAX_DIV				255
+#define PWM_DEFAULT_FREQ		1000 // Hz
+#define COUNTER_GATE_MS			1000 // window the counter frequency is measured over
+#define NOTIFY_RETRY_US			500  // how often the callbacks are posted again when the work queue had no room
+
+#if NUM_OF_GPIOEXP > 8
+#error "The GPIO expander registers only have room for 8 pins"
+#endif
+
+// expander pin index (register bit) to MCU pin
+static const uint8_t pins[NUM_OF_GPIOEXP] =
+{
+	PINS_GPIOEXP
+};
+
 static struct
 {
-	struct gpioexp_callback *callbacks;
+	uint8_t notify_pending;			// register bits of the pins with an edge the callbacks haven't seen yet
+	uint8_t notify_levels;			// register bits of the pin levels at their last edge
+	bool notify_queued;				// notify_work is posted, or an alarm posts it once the queue has room
+
+	uint8_t valid;					// register bits that have a pin behind them
+	uint8_t func_pins;				// register bits of the pins in PWM or counter mode
+	uint32_t sio_masks[NUM_OF_GPIOEXP];	// SIO bit of every expander pin
+
+	struct
+	{
+		uint8_t mode;		// GPM_*
+		bool refused;		// the last mode or PWM write didn't fit the pin or its PWM slice
+		uint8_t duty;		// PWM, 0 to 255
+		uint16_t freq;		// PWM, Hz
+		uint16_t wraps;		// counter, upper half of the edge count
+		uint32_t last_count;
+		uint32_t count_freq;	// counter, edges per second over the last gate window
+
+		uint8_t filter_ms;		// glitch filter, how long the input has to be stable, 0 is off
+		bool filter_pending;
+		bool filter_level;		// last level that made it through the filter
+		uint32_t last_edge;
+	} funcs[NUM_OF_GPIOEXP];
+	bool gate_running;
+
+	struct
+	{
+		struct gpioexp_event items[EVENT_QUEUE_SIZE];
+		uint8_t count;
+		uint8_t read_idx;
+		bool overflow;
+	} events;
 } self;
 
-static void set_dir(uint8_t gpio, uint8_t gpio_idx, uint8_t dir)
+// register bits (one per expander pin) to SIO bits (one per MCU pin)
+static uint32_t to_sio(uint8_t bits)
 {
-#ifndef NDEBUG
-	printf("%s: gpio: %d, gpio_idx: %d, dir: %d\r\n", __func__, gpio, gpio_idx, dir);
-#endif
+	uint32_t sio = 0;
 
-	gpio_init(gpio);
-
-	if (dir == DIR_INPUT) {
-		if (reg_is_bit_set(REG_ID_PUE, (1 << gpio_idx))) {
-			if (reg_is_bit_set(REG_ID_PUD, (1 << gpio_idx)) == PUD_UP) {
-				gpio_is_pulled_up(gpio);
-			} else {
-				gpio_is_pulled_down(gpio);
-			}
-		} else {
-			gpio_disable_pulls(gpio);
-		}
+	for (uint8_t i = 0; i < NUM_OF_GPIOEXP; ++i) {
+		if (bits & (1 << i))
+			sio |= self.sio_masks[i];
+	}
+
+	return sio;
+}
+
+static uint8_t from_sio(uint32_t sio)
+{
+	uint8_t bits = 0;
 
-		gpio_set_dir(gpio, GPIO_IN);
+	for (uint8_t i = 0; i < NUM_OF_GPIOEXP; ++i) {
+		if (sio & self.sio_masks[i])
+			bits |= (1 << i);
+	}
 
-		gpio_set_irq_enabled(gpio, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, true);
+	return bits;
+}
 
-		reg_set_bit(REG_ID_DIR, (1 << gpio_idx));
-	} else {
-		gpio_set_irq_enabled(gpio, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, false);
+static void apply_pulls(uint8_t bits)
+{
+	for (uint8_t i = 0; i < NUM_OF_GPIOEXP; ++i) {
+		if (!(bits & (1 << i)))
+			continue;
 
-		gpio_set_dir(gpio, GPIO_OUT);
+		const bool enabled = reg_is_bit_set(REG_ID_PUE, (1 << i));
+		const bool up = (reg_is_bit_set(REG_ID_PUD, (1 << i)) == PUD_UP);
 
-		reg_clear_bit(REG_ID_DIR, (1 << gpio_idx));
+		gpio_set_pulls(pins[i], enabled && up, enabled && !up);
 	}
 }
 
-void gpioexp_gpio_irq(uint gpio, uint32_t events)
+static void set_irqs(uint8_t bits, bool enabled)
 {
-	(void)gpio;
-	(void)events;
-
-#define CALLBACK(bit) \
-	if (gpio == PIN_GPIOEXP ## bit) { \
-		struct gpioexp_callback *cb = self.callbacks; \
-		while (cb) { \
-			cb->func(PIN_GPIOEXP ## bit, bit); \
-			cb = cb->next; \
-		} \
-		return; \
+	for (uint8_t i = 0; i < NUM_OF_GPIOEXP; ++i) {
+		if (bits & (1 << i))
+			gpio_set_irq_enabled(pins[i], GPIOEXP_IRQ_EDGES, enabled);
 	}
+}
 
-#ifdef PIN_GPIOEXP0
-	CALLBACK(0)
-#endif
+static void push_event(uint32_t time, uint8_t gpio_idx, bool level)
+{
+	if (self.events.count >= EVENT_QUEUE_SIZE) {
+		// keep the oldest ones, the host can tell from the overflow flag that the tail is missing
+		self.events.overflow = true;
+		return;
+	}
 
-#ifdef PIN_GPIOEXP1
-	CALLBACK(1)
-#endif
+	struct gpioexp_event *event = &self.events.items[(self.events.read_idx + self.events.count) % EVENT_QUEUE_SIZE];
+	event->time = time;
+	event->gpio_idx = gpio_idx;
+	event->level = level;
 
-#ifdef PIN_GPIOEXP2
-	CALLBACK(2)
-#endif
+	++self.events.count;
+}
 
-#ifdef PIN_GPIOEXP3
-	CALLBACK(3)
-#endif
+static void record_edges(uint8_t gpio_idx, uint32_t events, bool level, uint32_t time)
+{
+	if (!reg_is_bit_set(REG_ID_GEC, (1 << gpio_idx)))
+		return;
 
-#ifdef PIN_GPIOEXP4
-	CALLBACK(4)
-#endif
+	// the pin toggled twice before the irq ran, the current level tells which edge was last
+	if ((events & GPIOEXP_IRQ_EDGES) == GPIOEXP_IRQ_EDGES)
+		push_event(time, gpio_idx, !level);
 
-#ifdef PIN_GPIOEXP5
-	CALLBACK(5)
-#endif
+	push_event(time, gpio_idx, level);
+}
 
-#ifdef PIN_GPIOEXP6
-	CALLBACK(6)
-#endif
+bool gpioexp_pop_event(struct gpioexp_event *event)
+{
+	const uint32_t irq = save_and_disable_interrupts();
 
-#ifdef PIN_GPIOEXP7
-	CALLBACK(7)
-#endif
+	const bool available = (self.events.count > 0);
+	if (available) {
+		*event = self.events.items[self.events.read_idx];
+		self.events.read_idx = (self.events.read_idx + 1) % EVENT_QUEUE_SIZE;
+		--self.events.count;
+	}
+
+	restore_interrupts(irq);
+
+	return available;
+}
+
+uint8_t gpioexp_event_count(void)
+{
+	return self.events.count;
+}
+
+bool gpioexp_take_event_overflow(void)
+{
+	const uint32_t irq = save_and_disable_interrupts();
+
+	const bool overflow = self.events.overflow;
+	self.events.overflow = false;
+
+	restore_interrupts(irq);
+
+	return overflow;
+}
+
+static uint32_t read_count(uint8_t gpio_idx);
+
+// the counter slices wrap every 65536 edges, the irq keeps the upper half of the count
+static void pwm_wrap_irq(void)
+{
+	const uint32_t status = pwm_get_irq_status_mask();
+
+	for (uint8_t i = 0; i < NUM_OF_GPIOEXP; ++i) {
+		const uint slice = pwm_gpio_to_slice_num(pins[i]);
+
+		if ((self.funcs[i].mode != GPM_COUNTER) || !(status & (1 << slice)))
+			continue;
+
+		pwm_clear_irq(slice);
+		++self.funcs[i].wraps;
+	}
+}
+
+// edges per gate window turned into a frequency, stops once no pin is counting
+static int64_t gate_task(alarm_id_t id, void *user_data)
+{
+	(void)id;
+	(void)user_data;
+
+	bool counting = false;
+
+	for (uint8_t i = 0; i < NUM_OF_GPIOEXP; ++i) {
+		if (self.funcs[i].mode != GPM_COUNTER)
+			continue;
+
+		const uint32_t count = read_count(i);
+
+		self.funcs[i].count_freq = ((count - self.funcs[i].last_count) * 1000) / COUNTER_GATE_MS;
+		self.funcs[i].last_count = count;
+		counting = true;
+	}
+
+	self.gate_running = counting;
+
+	// negative value means interval since last alarm time
+	return counting ? -(COUNTER_GATE_MS * 1000) : 0;
+}
+
+// applies REG_DIR, and the pulls and edge irqs that go with it, to the given pins
+static void configure_gpio(uint8_t bits)
+{
+	const uint8_t dir = reg_get_value(REG_ID_DIR);
+	const uint8_t inputs = bits & dir;
+
+	// no edges from pins that are about to become outputs, or from the switch itself
+	set_irqs(bits, false);
+	apply_pulls(inputs);
+
+	// all the pins turn around at the same time, GPIO_OUT is 1 so the output bits are the inverted register bits
+	gpio_set_dir_masked(to_sio(bits), to_sio(~dir));
+
+	for (uint8_t i = 0; i < NUM_OF_GPIOEXP; ++i) {
+		if (inputs & (1 << i))
+			self.funcs[i].filter_level = gpio_get(pins[i]);
+	}
+
+	set_irqs(inputs, true);
+}
+
+static void apply_pwm(uint8_t gpio_idx)
+{
+	const uint gpio = pins[gpio_idx];
+	const uint slice = pwm_gpio_to_slice_num(gpio);
+	const uint32_t period = clock_get_hz(clk_sys) / MAX(1, self.funcs[gpio_idx].freq); // in sys clocks
+
+	// smallest divider that fits the period in the counter, for the finest duty steps
+	const uint32_t div = MAX(1, MIN((period + PWM_MAX_WRAP) / (PWM_MAX_WRAP + 1), PWM_MAX_DIV));
+	const uint32_t wrap = MAX(1, MIN((period / div) - 1, PWM_MAX_WRAP));
+
+	pwm_set_clkdiv_int_frac(slice, div, 0);
+	pwm_set_wrap(slice, wrap);
+
+	// 255 is fully on, so the top has to be past the wrap
+	pwm_set_gpio_level(gpio, (self.funcs[gpio_idx].duty * (wrap + 1)) / 255);
+}
+
+// another pin in PWM or counter mode on the same PWM slice, or -1
+static int8_t slice_user(uint8_t gpio_idx)
+{
+	const uint slice = pwm_gpio_to_slice_num(pins[gpio_idx]);
+
+	for (uint8_t i = 0; i < NUM_OF_GPIOEXP; ++i) {
+		if ((i != gpio_idx) && (self.funcs[i].mode != GPM_GPIO) && (pwm_gpio_to_slice_num(pins[i]) == slice))
+			return i;
+	}
+
+	return -1;
+}
+
+// a slice has one divider and wrap, two PWM pins on it need the same frequency and a counter needs the slice alone
+static bool slice_conflict(uint8_t gpio_idx, uint8_t mode, uint16_t freq)
+{
+	const int8_t other = slice_user(gpio_idx);
+
+	if ((mode == GPM_GPIO) || (other < 0))
+		return false;
+
+	return (mode != GPM_PWM) || (self.funcs[other].mode != GPM_PWM) || (self.funcs[other].freq != freq);
+}
+
+static void start_pwm(uint8_t gpio_idx)
+{
+	const uint gpio = pins[gpio_idx];
+
+	// the other pin on the slice runs already, at the same frequency, and pwm_init would reset its level
+	if (slice_user(gpio_idx) < 0) {
+		pwm_config config = pwm_get_default_config();
+		pwm_init(pwm_gpio_to_slice_num(gpio), &config, false);
+	}
+
+	apply_pwm(gpio_idx);
+
+	pwm_set_enabled(pwm_gpio_to_slice_num(gpio), true);
+	gpio_set_function(gpio, GPIO_FUNC_PWM);
+}
+
+static void start_counter(uint8_t gpio_idx)
+{
+	const uint gpio = pins[gpio_idx];
+	const uint slice = pwm_gpio_to_slice_num(gpio);
+
+	// the slice counts the rising edges on its B pin, and wraps into the software high half
+	pwm_config config = pwm_get_default_config();
+	pwm_config_set_clkdiv_mode(&config, PWM_DIV_B_RISING);
+	pwm_config_set_clkdiv_int(&config, 1);
+	pwm_config_set_wrap(&config, PWM_MAX_WRAP);
+	pwm_init(slice, &config, false);
+
+	self.funcs[gpio_idx].wraps = 0;
+	self.funcs[gpio_idx].last_count = 0;
+	self.funcs[gpio_idx].count_freq = 0;
+
+	pwm_clear_irq(slice);
+	pwm_set_irq_enabled(slice, true);
+
+	gpio_set_function(gpio, GPIO_FUNC_PWM);
+	pwm_set_enabled(slice, true);
+
+	if (!self.gate_running)
+		self.gate_running = (add_alarm_in_ms(COUNTER_GATE_MS, gate_task, NULL, true) > 0);
+}
+
+static void stop_func(uint8_t gpio_idx)
+{
+	const uint gpio = pins[gpio_idx];
+	const uint slice = pwm_gpio_to_slice_num(gpio);
+
+	gpio_set_function(gpio, GPIO_FUNC_SIO);
+
+	// the other pin on the slice keeps it
+	if (slice_user(gpio_idx) >= 0) {
+		pwm_set_gpio_level(gpio, 0);
+		return;
+	}
+
+	pwm_set_irq_enabled(slice, false);
+	pwm_set_enabled(slice, false);
+}
+
+// the PWM dividers are counted in system clocks, keep the frequencies where the host set them
+void gpioexp_clock_cb(uint32_t sys_hz)
+{
+	(void)sys_hz;
+
+	for (uint8_t i = 0; i < NUM_OF_GPIOEXP; ++i) {
+		if (self.funcs[i].mode == GPM_PWM)
+			apply_pwm(i);
+	}
+}
+
+bool gpioexp_set_mode(uint8_t gpio_idx, uint8_t mode)
+{
+	if (gpio_idx >= NUM_OF_GPIOEXP)
+		return false;
+
+	// the PWM slices can only count edges on their B pin
+	const bool supported = (mode <= GPM_COUNTER) &&
+						   ((mode != GPM_COUNTER) || (pwm_gpio_to_channel(pins[gpio_idx]) == PWM_CHAN_B));
+
+	// the other pin on the slice would silently get a new divider and wrap otherwise
+	self.funcs[gpio_idx].refused = !supported || slice_conflict(gpio_idx, mode, self.funcs[gpio_idx].freq);
+	if (self.funcs[gpio_idx].refused)
+		return false;
+
+	if (mode == self.funcs[gpio_idx].mode)
+		return true;
+
+	if (self.funcs[gpio_idx].mode != GPM_GPIO)
+		stop_func(gpio_idx);
+
+	self.funcs[gpio_idx].mode = mode;
+
+	switch (mode) {
+	case GPM_PWM:
+		self.func_pins |= (1 << gpio_idx);
+		set_irqs(1 << gpio_idx, false);
+		start_pwm(gpio_idx);
+		break;
+
+	case GPM_COUNTER:
+		self.func_pins |= (1 << gpio_idx);
+		set_irqs(1 << gpio_idx, false);
+		apply_pulls(1 << gpio_idx);
+		start_counter(gpio_idx);
+		break;
+
+	default:
+		self.func_pins &= ~(1 << gpio_idx);
+		configure_gpio(1 << gpio_idx);
+		break;
+	}
+
+	return true;
+}
+
+uint8_t gpioexp_get_mode(uint8_t gpio_idx)
+{
+	return (gpio_idx < NUM_OF_GPIOEXP) ? self.funcs[gpio_idx].mode : GPM_GPIO;
+}
+
+bool gpioexp_was_refused(uint8_t gpio_idx)
+{
+	return (gpio_idx < NUM_OF_GPIOEXP) && self.funcs[gpio_idx].refused;
+}
+
+bool gpioexp_set_pwm(uint8_t gpio_idx, uint16_t freq, uint8_t duty)
+{
+	if (gpio_idx >= NUM_OF_GPIOEXP)
+		return false;
+
+	// the frequency is the slice's, a PWM pin sharing it keeps the one it has
+	self.funcs[gpio_idx].refused = (self.funcs[gpio_idx].mode == GPM_PWM) && slice_conflict(gpio_idx, GPM_PWM, freq);
+	if (self.funcs[gpio_idx].refused)
+		return false;
+
+	self.funcs[gpio_idx].freq = freq;
+	self.funcs[gpio_idx].duty = duty;
+
+	if (self.funcs[gpio_idx].mode == GPM_PWM)
+		apply_pwm(gpio_idx);
+
+	return true;
+}
+
+uint16_t gpioexp_get_pwm_freq(uint8_t gpio_idx)
+{
+	return (gpio_idx < NUM_OF_GPIOEXP) ? self.funcs[gpio_idx].freq : 0;
+}
+
+uint8_t gpioexp_get_pwm_duty(uint8_t gpio_idx)
+{
+	return (gpio_idx < NUM_OF_GPIOEXP) ? self.funcs[gpio_idx].duty : 0;
+}
+
+static uint32_t read_count(uint8_t gpio_idx)
+{
+	const uint slice = pwm_gpio_to_slice_num(pins[gpio_idx]);
+	const uint32_t irq = save_and_disable_interrupts();
+
+	uint32_t wraps = self.funcs[gpio_idx].wraps;
+	const uint16_t counter = pwm_get_counter(slice);
+
+	// wrapped but the irq didn't get to run yet
+	if ((pwm_get_irq_status_mask() & (1 << slice)) && (counter < (PWM_MAX_WRAP / 2)))
+		++wraps;
+
+	restore_interrupts(irq);
+
+	return (wraps << 16) | counter;
+}
+
+uint32_t gpioexp_get_count(uint8_t gpio_idx)
+{
+	if ((gpio_idx >= NUM_OF_GPIOEXP) || (self.funcs[gpio_idx].mode != GPM_COUNTER))
+		return 0;
+
+	return read_count(gpio_idx);
+}
+
+uint32_t gpioexp_get_count_freq(uint8_t gpio_idx)
+{
+	if ((gpio_idx >= NUM_OF_GPIOEXP) || (self.funcs[gpio_idx].mode != GPM_COUNTER))
+		return 0;
+
+	return self.funcs[gpio_idx].count_freq;
+}
+
+void gpioexp_reset_count(uint8_t gpio_idx)
+{
+	if ((gpio_idx >= NUM_OF_GPIOEXP) || (self.funcs[gpio_idx].mode != GPM_COUNTER))
+		return;
+
+	const uint32_t irq = save_and_disable_interrupts();
+
+	const uint slice = pwm_gpio_to_slice_num(pins[gpio_idx]);
+	pwm_set_counter(slice, 0);
+	pwm_clear_irq(slice);
+
+	self.funcs[gpio_idx].wraps = 0;
+	self.funcs[gpio_idx].last_count = 0;
+
+	restore_interrupts(irq);
+}
+
+static void notify_work(uint32_t arg)
+{
+	(void)arg;
+
+	const uint32_t irq = save_and_disable_interrupts();
+	const uint8_t pending = self.notify_pending;
+	const uint8_t levels = self.notify_levels;
+	self.notify_pending = 0;
+	self.notify_queued = false;
+	restore_interrupts(irq);
+
+	for (uint8_t i = 0; i < NUM_OF_GPIOEXP; ++i) {
+		if (!(pending & (1 << i)))
+			continue;
+
+		events_gpioexp(pins[i], i, (levels & (1 << i)) != 0);
+	}
+}
+
+static int64_t notify_retry_task(alarm_id_t id, void *user_data)
+{
+	(void)id;
+	(void)user_data;
+
+	if (!work_post(WORK_PRIO_NORMAL, notify_work, 0))
+		return NOTIFY_RETRY_US;
+
+	return 0;
+}
+
+static void report_edges(uint8_t gpio_idx, uint32_t events, bool level, uint32_t time)
+{
+	record_edges(gpio_idx, events, level, time);
+
+	self.notify_pending |= (1 << gpio_idx);
+
+	if (level)
+		self.notify_levels |= (1 << gpio_idx);
+	else
+		self.notify_levels &= ~(1 << gpio_idx);
+
+	// the callbacks pulse the INT pin and queue usb reports, they run in the main loop.
+	// the edges themselves are in the event queue with their time, several of them only need one call.
+	if (self.notify_queued)
+		return;
+
+	self.notify_queued = true;
+
+	// the queue is full, the pending pins wait for the retry instead of being dropped
+	if (!work_post(WORK_PRIO_NORMAL, notify_work, 0))
+		add_alarm_in_us(NOTIFY_RETRY_US, notify_retry_task, NULL, true);
+}
+
+static int64_t filter_task(alarm_id_t id, void *user_data)
+{
+	(void)id;
+
+	const uint8_t gpio_idx = (uint8_t)(uintptr_t)user_data;
+	const uint32_t stable_us = self.funcs[gpio_idx].filter_ms * 1000;
+	const uint32_t quiet_us = time_us_32() - self.funcs[gpio_idx].last_edge;
+
+	// still bouncing, check again once it's been quiet for long enough
+	if (quiet_us < stable_us)
+		return stable_us - quiet_us;
+
+	self.funcs[gpio_idx].filter_pending = false;
+
+	// the pin was reconfigured in the meantime
+	if ((self.funcs[gpio_idx].mode != GPM_GPIO) || !reg_is_bit_set(REG_ID_DIR, (1 << gpio_idx)))
+		return 0;
+
+	// bounced back to where it was, nothing happened as far as the host is concerned
+	const bool level = gpio_get(pins[gpio_idx]);
+	if (level == self.funcs[gpio_idx].filter_level)
+		return 0;
+
+	self.funcs[gpio_idx].filter_level = level;
+
+	report_edges(gpio_idx, level ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL, level, self.funcs[gpio_idx].last_edge);
+
+	return 0;
+}
+
+void gpioexp_gpio_irq(uint gpio, uint32_t events)
+{
+	const uint32_t now = time_us_32();
+
+	for (uint8_t i = 0; i < NUM_OF_GPIOEXP; ++i) {
+		if (pins[i] != gpio)
+			continue;
+
+		if (!self.funcs[i].filter_ms) {
+			report_edges(i, events, gpio_get(gpio), now);
+			return;
+		}
+
+		// a bouncing input only costs this much per edge, the edge is reported once the input settled
+		self.funcs[i].last_edge = now;
+
+		if (!self.funcs[i].filter_pending)
+			self.funcs[i].filter_pending = (add_alarm_in_ms(self.funcs[i].filter_ms, filter_task, (void *)(uintptr_t)i, true) > 0);
+
+		return;
+	}
+}
+
+void gpioexp_set_filter(uint8_t gpio_idx, uint8_t stable_ms)
+{
+	if (gpio_idx >= NUM_OF_GPIOEXP)
+		return;
+
+	self.funcs[gpio_idx].filter_level = gpio_get(pins[gpio_idx]);
+	self.funcs[gpio_idx].filter_ms = stable_ms;
+}
+
+uint8_t gpioexp_get_filter(uint8_t gpio_idx)
+{
+	return (gpio_idx < NUM_OF_GPIOEXP) ? self.funcs[gpio_idx].filter_ms : 0;
 }
 
 void gpioexp_update_dir(uint8_t new_dir)
@@ -97,37 +608,15 @@ void gpioexp_update_dir(uint8_t new_dir)
 #endif
 
 	const uint8_t old_dir = reg_get_value(REG_ID_DIR);
+	const uint8_t changed = (old_dir ^ new_dir) & self.valid;
 
-	(void)old_dir; // Shut up warning in case no GPIOs configured
+	if (!changed)
+		return;
 
-#define UPDATE_DIR(bit) \
-	if ((old_dir & (1 << bit)) != (new_dir & (1 << bit))) \
-		set_dir(PIN_GPIOEXP ## bit, bit, (new_dir & (1 << bit)) != 0);
+	reg_set_value(REG_ID_DIR, (old_dir & ~changed) | (new_dir & changed));
 
-#ifdef PIN_GPIOEXP0
-	UPDATE_DIR(0)
-#endif
-#ifdef PIN_GPIOEXP1
-	UPDATE_DIR(1)
-#endif
-#ifdef PIN_GPIOEXP2
-	UPDATE_DIR(2)
-#endif
-#ifdef PIN_GPIOEXP3
-	UPDATE_DIR(3)
-#endif
-#ifdef PIN_GPIOEXP4
-	UPDATE_DIR(4)
-#endif
-#ifdef PIN_GPIOEXP5
-	UPDATE_DIR(5)
-#endif
-#ifdef PIN_GPIOEXP6
-	UPDATE_DIR(6)
-#endif
-#ifdef PIN_GPIOEXP7
-	UPDATE_DIR(7)
-#endif
+	// pins in PWM or counter mode take the new direction once they're back to GPIO
+	configure_gpio(changed & ~self.func_pins);
 }
 
 void gpioexp_update_pue_pud(uint8_t new_pue, uint8_t new_pud)
@@ -136,46 +625,13 @@ void gpioexp_update_pue_pud(uint8_t new_pue, uint8_t new_pud)
 	printf("%s: pue: 0x%02X, pud: 0x%02X\r\n", __func__, new_pue, new_pud);
 #endif
 
-	const uint8_t old_pue = reg_get_value(REG_ID_PUE);
-	const uint8_t old_pud = reg_get_value(REG_ID_PUD);
-
-	// Shut up warnings in case no GPIOs configured
-	(void)old_pue;
-	(void)old_pud;
+	const uint8_t changed = ((reg_get_value(REG_ID_PUE) ^ new_pue) | (reg_get_value(REG_ID_PUD) ^ new_pud));
 
 	reg_set_value(REG_ID_PUE, new_pue);
 	reg_set_value(REG_ID_PUD, new_pud);
 
-#define UPDATE_PULL(bit) \
-	if (((old_pue & (1 << bit)) != (new_pue & (1 << bit))) || \
-		((old_pud & (1 << bit)) != (new_pud & (1 << bit)))) { \
-		set_dir(PIN_GPIOEXP ## bit, bit, reg_is_bit_set(REG_ID_DIR, (1 << bit))); \
-	}
-
-#ifdef PIN_GPIOEXP0
-	UPDATE_PULL(0)
-#endif
-#ifdef PIN_GPIOEXP1
-	UPDATE_PULL(1)
-#endif
-#ifdef PIN_GPIOEXP2
-	UPDATE_PULL(2)
-#endif
-#ifdef PIN_GPIOEXP3
-	UPDATE_PULL(3)
-#endif
-#ifdef PIN_GPIOEXP4
-	UPDATE_PULL(4)
-#endif
-#ifdef PIN_GPIOEXP5
-	UPDATE_PULL(5)
-#endif
-#ifdef PIN_GPIOEXP6
-	UPDATE_PULL(6)
-#endif
-#ifdef PIN_GPIOEXP7
-	UPDATE_PULL(7)
-#endif
+	// the pulls only matter for inputs
+	apply_pulls(changed & reg_get_value(REG_ID_DIR) & self.valid & ~self.func_pins);
 }
 
 void gpioexp_set_value(uint8_t value)
@@ -184,90 +640,31 @@ void gpioexp_set_value(uint8_t value)
 	printf("%s: value: 0x%02X\r\n", __func__, value);
 #endif
 
-#define SET_VALUE(bit) \
-	if (reg_is_bit_set(REG_ID_DIR, (1 << bit)) == DIR_OUTPUT) { \
-		gpio_put(PIN_GPIOEXP ## bit, (value & (1 << bit))); \
-	}
+	const uint8_t outputs = ~reg_get_value(REG_ID_DIR) & self.valid & ~self.func_pins;
 
-#ifdef PIN_GPIOEXP0
-	SET_VALUE(0)
-#endif
-#ifdef PIN_GPIOEXP1
-	SET_VALUE(1)
-#endif
-#ifdef PIN_GPIOEXP2
-	SET_VALUE(2)
-#endif
-#ifdef PIN_GPIOEXP3
-	SET_VALUE(3)
-#endif
-#ifdef PIN_GPIOEXP4
-	SET_VALUE(4)
-#endif
-#ifdef PIN_GPIOEXP5
-	SET_VALUE(5)
-#endif
-#ifdef PIN_GPIOEXP6
-	SET_VALUE(6)
-#endif
-#ifdef PIN_GPIOEXP7
-	SET_VALUE(7)
-#endif
+	// one SIO write, so all the outputs change at the same time
+	gpio_put_masked(to_sio(outputs), to_sio(value));
 }
 
 uint8_t gpioexp_get_value(void)
 {
-	uint8_t value = 0;
-
-#define GET_VALUE(bit) \
-	value |= (gpio_get(PIN_GPIOEXP ## bit) << bit);
-
-#ifdef PIN_GPIOEXP0
-	GET_VALUE(0)
-#endif
-#ifdef PIN_GPIOEXP1
-	GET_VALUE(1)
-#endif
-#ifdef PIN_GPIOEXP2
-	GET_VALUE(2)
-#endif
-#ifdef PIN_GPIOEXP3
-	GET_VALUE(3)
-#endif
-#ifdef PIN_GPIOEXP4
-	GET_VALUE(4)
-#endif
-#ifdef PIN_GPIOEXP5
-	GET_VALUE(5)
-#endif
-#ifdef PIN_GPIOEXP6
-	GET_VALUE(6)
-#endif
-#ifdef PIN_GPIOEXP7
-	GET_VALUE(7)
-#endif
-
-	return value;
+	return from_sio(gpio_get_all());
 }
 
-void gpioexp_add_int_callback(struct gpioexp_callback *callback)
+void gpioexp_init(void)
 {
-	// first callback
-	if (!self.callbacks) {
-		self.callbacks = callback;
-		return;
+	for (uint8_t i = 0; i < NUM_OF_GPIOEXP; ++i) {
+		self.sio_masks[i] = (1u << pins[i]);
+		self.valid |= (1 << i);
+		self.funcs[i].freq = PWM_DEFAULT_FREQ;
 	}
 
-	// find last and insert after
-	struct gpioexp_callback *cb = self.callbacks;
-	while (cb->next)
-		cb = cb->next;
+	// all pins start as inputs, outputs are low until REG_GIO is written
+	gpio_init_mask(to_sio(self.valid));
 
-	cb->next = callback;
-}
+	// Configure all the way the registers say, the saved config may have some as outputs
+	configure_gpio(self.valid);
 
-void gpioexp_init(void)
-{
-	// Configure all to inputs
-	gpioexp_update_dir(0xFF);
+	irq_set_exclusive_handler(PWM_IRQ_WRAP, pwm_wrap_irq);
+	irq_set_enabled(PWM_IRQ_WRAP, true);
 }
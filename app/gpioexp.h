@@ -1,20 +1,46 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <sys/types.h>
 
-struct gpioexp_callback
+struct gpioexp_event
 {
-	void (*func)(uint8_t gpio, uint8_t gpio_idx);
-	struct gpioexp_callback *next;
+	uint32_t time;		// time_us_32() when the edge was seen
+	uint8_t gpio_idx;
+	bool level;			// level after the edge
 };
 
 void gpioexp_gpio_irq(uint gpio, uint32_t events);
 
+// edges of the pins enabled in REG_GEC, oldest first
+bool gpioexp_pop_event(struct gpioexp_event *event);
+uint8_t gpioexp_event_count(void);
+bool gpioexp_take_event_overflow(void); // returns whether events were lost since the last call
+
 void gpioexp_update_dir(uint8_t dir);
 void gpioexp_update_pue_pud(uint8_t pue, uint8_t pud);
 
+// gpio_idx in GPM_PWM/GPM_COUNTER mode isn't affected by REG_DIR/REG_GIO until it's back in GPM_GPIO,
+// returns false if the pin can't do the mode, or another pin on its PWM slice is set up differently
+bool gpioexp_set_mode(uint8_t gpio_idx, uint8_t mode);
+uint8_t gpioexp_get_mode(uint8_t gpio_idx);
+bool gpioexp_was_refused(uint8_t gpio_idx); // the last gpioexp_set_mode or gpioexp_set_pwm returned false
+
+// returns false if another PWM pin on the slice runs at a different frequency
+bool gpioexp_set_pwm(uint8_t gpio_idx, uint16_t freq, uint8_t duty);
+uint16_t gpioexp_get_pwm_freq(uint8_t gpio_idx);
+uint8_t gpioexp_get_pwm_duty(uint8_t gpio_idx);
+
+uint32_t gpioexp_get_count(uint8_t gpio_idx);		// rising edges since the mode was set or the count reset
+uint32_t gpioexp_get_count_freq(uint8_t gpio_idx);	// rising edges per second
+void gpioexp_reset_count(uint8_t gpio_idx);
+
+// edges of gpio_idx are only reported once the input was stable for stable_ms, 0 turns the filter off
+void gpioexp_set_filter(uint8_t gpio_idx, uint8_t stable_ms);
+uint8_t gpioexp_get_filter(uint8_t gpio_idx);
+
 void gpioexp_set_value(uint8_t value);
 uint8_t gpioexp_get_value(void);
 
-void gpioexp_add_int_callback(struct gpioexp_callback *callback);
 void gpioexp_init(void);
@@ -1,14 +1,27 @@
 #include "interrupt.h"
 
 #include "app_config.h"
+#include "events.h"
+#include "gesture.h"
 #include "gpioexp.h"
 #include "keyboard.h"
+#include "perf.h"
 #include "reg.h"
-#include "touchpad.h"
+#include "trace.h"
 
 #include <pico/stdlib.h>
 
-static void key_cb(char key, enum key_state state)
+static void pulse(void)
+{
+	perf_count(PERF_INT_PULSES);
+	trace(TRACE_INT_PULSE, reg_get_value(REG_ID_INT), 0);
+
+	gpio_put(PIN_INT, 0);
+	busy_wait_ms(reg_get_value(REG_ID_IND));
+	gpio_put(PIN_INT, 1);
+}
+
+void interrupt_key_cb(char key, enum key_state state)
 {
 	(void)key;
 	(void)state;
@@ -18,13 +31,10 @@ static void key_cb(char key, enum key_state state)
 
 	reg_set_bit(REG_ID_INT, INT_KEY);
 
-	gpio_put(PIN_INT, 0);
-	busy_wait_ms(reg_get_value(REG_ID_IND));
-	gpio_put(PIN_INT, 1);
+	pulse();
 }
-static struct key_callback key_callback = { .func = key_cb };
 
-static void key_lock_cb(bool caps_changed, bool num_changed)
+void interrupt_key_lock_cb(bool caps_changed, bool num_changed)
 {
 	bool do_int = false;
 
@@ -38,15 +48,11 @@ static void key_lock_cb(bool caps_changed, bool num_changed)
 		do_int = true;
 	}
 
-	if (do_int) {
-		gpio_put(PIN_INT, 0);
-		busy_wait_ms(reg_get_value(REG_ID_IND));
-		gpio_put(PIN_INT, 1);
-	}
+	if (do_int)
+		pulse();
 }
-static struct key_lock_callback key_lock_callback = { .func = key_lock_cb };
 
-static void touch_cb(int8_t x, int8_t y)
+void interrupt_touch_cb(int8_t x, int8_t y)
 {
 	(void)x;
 	(void)y;
@@ -56,15 +62,30 @@ static void touch_cb(int8_t x, int8_t y)
 
 	reg_set_bit(REG_ID_INT, INT_TOUCH);
 
-	gpio_put(PIN_INT, 0);
-	busy_wait_ms(reg_get_value(REG_ID_IND));
-	gpio_put(PIN_INT, 1);
+	pulse();
 }
-static struct touch_callback touch_callback = { .func = touch_cb };
 
-static void gpioexp_cb(uint8_t gpio, uint8_t gpio_idx)
+void interrupt_gesture_cb(enum gesture gesture, int8_t x, int8_t y)
+{
+	(void)x;
+	(void)y;
+
+	if (!reg_is_bit_set(REG_ID_CF2, CF2_TOUCH_INT))
+		return;
+
+	// scrolling comes in fine steps, one pulse is enough until the host has seen the last one
+	if ((gesture == GESTURE_SCROLL) && reg_is_bit_set(REG_ID_INT, INT_TOUCH))
+		return;
+
+	reg_set_bit(REG_ID_INT, INT_TOUCH);
+
+	pulse();
+}
+
+void interrupt_gpioexp_cb(uint8_t gpio, uint8_t gpio_idx, bool level)
 {
 	(void)gpio;
+	(void)level;
 
 	if (!reg_is_bit_set(REG_ID_GIC, (1 << gpio_idx)))
 		return;
@@ -72,11 +93,8 @@ static void gpioexp_cb(uint8_t gpio, uint8_t gpio_idx)
 	reg_set_bit(REG_ID_INT, INT_GPIO);
 	reg_set_bit(REG_ID_GIN, (1 << gpio_idx));
 
-	gpio_put(PIN_INT, 0);
-	busy_wait_ms(reg_get_value(REG_ID_IND));
-	gpio_put(PIN_INT, 1);
+	pulse();
 }
-static struct gpioexp_callback gpioexp_callback = { .func = gpioexp_cb };
 
 void interrupt_init(void)
 {
@@ -84,11 +102,4 @@ void interrupt_init(void)
 	gpio_set_dir(PIN_INT, GPIO_OUT);
 	gpio_pull_up(PIN_INT);
 	gpio_put(PIN_INT, true);
-
-	keyboard_add_key_callback(&key_callback);
-	keyboard_add_lock_callback(&key_lock_callback);
-
-	touchpad_add_touch_callback(&touch_callback);
-
-	gpioexp_add_int_callback(&gpioexp_callback);
 }
@@ -1,7 +1,12 @@
 #include "app_config.h"
+#include "events.h"
 #include "fifo.h"
 #include "keyboard.h"
+#include "perf.h"
+#include "power.h"
 #include "reg.h"
+#include "trace.h"
+#include "work.h"
 
 #include <pico/stdlib.h>
 
@@ -63,9 +68,6 @@ static const uint8_t btn_pins[NUM_OF_BTNS] =
 
 static struct
 {
-	struct key_lock_callback *lock_callbacks;
-	struct key_callback *key_callbacks;
-
 	struct list_item list[LIST_SIZE];
 
 	bool mods[KEY_MOD_ID_LAST];
@@ -75,6 +77,11 @@ static struct
 
 	bool numlock_changed;
 	bool numlock;
+
+	alarm_id_t scan_alarm;
+	bool scan_posted;	// the last tick's scan is still waiting for the main loop
+	bool sleeping;		// stop scanning once no key is down
+	bool scan_stopped;	// waiting for a row pin edge
 } self;
 
 static void transition_to(struct list_item * const p_item, const enum key_state next_state)
@@ -86,6 +93,8 @@ static void transition_to(struct list_item * const p_item, const enum key_state
 	if (!p_entry)
 		return;
 
+	trace(TRACE_KEY, p_entry->chr, next_state);
+
 	if (p_item->effective_key == '\0') {
 		char key = p_entry->chr;
 		switch (p_entry->mod) {
@@ -169,14 +178,8 @@ static void next_item_state(struct list_item * const p_item, const bool pressed)
 					self.numlock_changed = false;
 				}
 
-				if (self.lock_callbacks && (self.capslock_changed || self.numlock_changed)) {
-					struct key_lock_callback *cb = self.lock_callbacks;
-					while (cb) {
-						cb->func(self.capslock_changed, self.numlock_changed);
-
-						cb = cb->next;
-					}
-				}
+				if (self.capslock_changed || self.numlock_changed)
+					events_key_lock(self.capslock_changed, self.numlock_changed);
 
 				transition_to(p_item, KEY_STATE_PRESSED);
 
@@ -210,10 +213,42 @@ static void next_item_state(struct list_item * const p_item, const bool pressed)
 	}
 }
 
-static int64_t timer_task(alarm_id_t id, void *user_data)
+// a pressed key pulls its row low as long as all columns are driven low, that edge wakes the system up
+static void stop_scan(bool dormant)
 {
-	(void)id;
-	(void)user_data;
+	for (uint32_t c = 0; c < NUM_OF_COLS; ++c) {
+		gpio_put(col_pins[c], 0);
+		gpio_set_dir(col_pins[c], GPIO_OUT);
+	}
+
+	for (uint32_t r = 0; r < NUM_OF_ROWS; ++r) {
+		gpio_set_irq_enabled(row_pins[r], GPIO_IRQ_EDGE_FALL, true);
+		gpio_set_dormant_irq_enabled(row_pins[r], GPIO_IRQ_EDGE_FALL, dormant);
+	}
+
+#if NUM_OF_BTNS > 0
+	for (uint32_t b = 0; b < NUM_OF_BTNS; ++b) {
+		gpio_set_irq_enabled(btn_pins[b], GPIO_IRQ_EDGE_FALL, true);
+		gpio_set_dormant_irq_enabled(btn_pins[b], GPIO_IRQ_EDGE_FALL, dormant);
+	}
+#endif
+
+	self.scan_stopped = true;
+}
+
+static void scan_work(uint32_t arg)
+{
+	(void)arg;
+
+	self.scan_posted = false;
+
+	// the scan was stopped after this tick was posted
+	if (self.scan_stopped)
+		return;
+
+	const uint32_t start_time = perf_start();
+
+	trace(TRACE_SCAN_START, 0, 0);
 
 	for (uint32_t c = 0; c < NUM_OF_COLS; ++c) {
 		gpio_pull_up(col_pins[c]);
@@ -294,14 +329,84 @@ static int64_t timer_task(alarm_id_t id, void *user_data)
 	}
 #endif
 
+	trace(TRACE_SCAN_END, 0, 0);
+
+	perf_time(PERF_TIMER_SCAN, start_time);
+
+	if (self.sleeping && !keyboard_is_any_key_down()) {
+		cancel_alarm(self.scan_alarm);
+		stop_scan(false);
+	}
+}
+
+static int64_t timer_task(alarm_id_t id, void *user_data)
+{
+	(void)id;
+	(void)user_data;
+
+	// the key callbacks pulse the INT pin and queue usb reports, so the scan runs in the main loop.
+	// a tick that finds the previous scan still waiting is skipped.
+	if (!self.scan_posted)
+		self.scan_posted = work_post(WORK_PRIO_NORMAL, scan_work, 0);
+
 	// negative value means interval since last alarm time
 	return -(reg_get_value(REG_ID_FRQ) * 1000);
 }
 
+static void start_scan(void)
+{
+	for (uint32_t r = 0; r < NUM_OF_ROWS; ++r) {
+		gpio_set_irq_enabled(row_pins[r], GPIO_IRQ_EDGE_FALL, false);
+		gpio_set_dormant_irq_enabled(row_pins[r], GPIO_IRQ_EDGE_FALL, false);
+	}
+
+#if NUM_OF_BTNS > 0
+	for (uint32_t b = 0; b < NUM_OF_BTNS; ++b) {
+		gpio_set_irq_enabled(btn_pins[b], GPIO_IRQ_EDGE_FALL, false);
+		gpio_set_dormant_irq_enabled(btn_pins[b], GPIO_IRQ_EDGE_FALL, false);
+	}
+#endif
+
+	for (uint32_t c = 0; c < NUM_OF_COLS; ++c) {
+		gpio_put(col_pins[c], 1);
+		gpio_disable_pulls(col_pins[c]);
+		gpio_set_dir(col_pins[c], GPIO_IN);
+	}
+
+	self.scan_stopped = false;
+	self.scan_alarm = add_alarm_in_ms(reg_get_value(REG_ID_FRQ), timer_task, NULL, true);
+}
+
+void keyboard_power_cb(enum power_state state)
+{
+	switch (state) {
+		case POWER_ACTIVE:
+			self.sleeping = false;
+
+			if (self.scan_stopped)
+				start_scan();
+			break;
+
+		case POWER_DORMANT:
+			// the timer stops with the clocks, so the scan can't wait for the keys to be released
+			if (!self.scan_stopped)
+				cancel_alarm(self.scan_alarm);
+
+			stop_scan(true);
+			break;
+
+		default:
+			self.sleeping = true;
+			break;
+	}
+}
+
 void keyboard_inject_event(char key, enum key_state state)
 {
 	const struct fifo_item item = { key, state };
 	if (!fifo_enqueue(item)) {
+		perf_count(PERF_FIFO_OVERFLOWS);
+
 		if (reg_is_bit_set(REG_ID_CFG, CFG_OVERFLOW_INT))
 			reg_set_bit(REG_ID_INT, INT_OVERFLOW);
 
@@ -309,12 +414,7 @@ void keyboard_inject_event(char key, enum key_state state)
 			fifo_enqueue_force(item);
 	}
 
-	struct key_callback *cb = self.key_callbacks;
-	while (cb) {
-		cb->func(key, state);
-
-		cb = cb->next;
-	}
+	events_key(key, state);
 }
 
 bool keyboard_is_key_down(char key)
@@ -337,41 +437,19 @@ bool keyboard_is_key_down(char key)
 	return false;
 }
 
-bool keyboard_is_mod_on(enum key_mod mod)
+bool keyboard_is_any_key_down(void)
 {
-	return self.mods[mod];
-}
-
-void keyboard_add_key_callback(struct key_callback *callback)
-{
-	// first callback
-	if (!self.key_callbacks) {
-		self.key_callbacks = callback;
-		return;
+	for (uint32_t i = 0; i < LIST_SIZE; ++i) {
+		if (self.list[i].p_entry != NULL)
+			return true;
 	}
 
-	// find last and insert after
-	struct key_callback *cb = self.key_callbacks;
-	while (cb->next)
-		cb = cb->next;
-
-	cb->next = callback;
+	return false;
 }
 
-void keyboard_add_lock_callback(struct key_lock_callback *callback)
+bool keyboard_is_mod_on(enum key_mod mod)
 {
-	// first callback
-	if (!self.lock_callbacks) {
-		self.lock_callbacks = callback;
-		return;
-	}
-
-	// find last and insert after
-	struct key_lock_callback *cb = self.lock_callbacks;
-	while (cb->next)
-		cb = cb->next;
-
-	cb->next = callback;
+	return self.mods[mod];
 }
 
 bool keyboard_get_capslock(void)
@@ -411,5 +489,5 @@ void keyboard_init(void)
 	}
 #endif
 
-	add_alarm_in_ms(reg_get_value(REG_ID_FRQ), timer_task, NULL, true);
+	self.scan_alarm = add_alarm_in_ms(reg_get_value(REG_ID_FRQ), timer_task, NULL, true);
 }
@@ -7,23 +7,31 @@
 #include "gpioexp.h"
 #include "interrupt.h"
 #include "keyboard.h"
+#include "power.h"
 #include "puppet_i2c.h"
 #include "reg.h"
+#include "settings.h"
 #include "touchpad.h"
 #include "usb.h"
+#include "work.h"
 
 // since the SDK doesn't support per-GPIO irq, we use this global irq and forward it
 static void gpio_irq(uint gpio, uint32_t events)
 {
+	const uint32_t start_time = time_us_32();
+
 //	printf("%s: gpio %d, events 0x%02X\r\n", __func__, gpio, events);
+	power_gpio_irq(gpio, events);
 	touchpad_gpio_irq(gpio, events);
 	gpioexp_gpio_irq(gpio, events);
+
+	work_irq_done(start_time);
 }
 
 // TODO: Microphone
 int main(void)
 {
-	// The here order is important because it determines callback call order
+	// the order the events reach the modules is set in events.h, this one only has to get the dependencies right
 	usb_init();
 
 #ifndef NDEBUG
@@ -32,6 +40,9 @@ int main(void)
 
 	reg_init();
 
+	// before anything uses the registers
+	settings_init();
+
 	backlight_init();
 
 	gpioexp_init();
@@ -42,6 +53,8 @@ int main(void)
 
 	interrupt_init();
 
+	power_init();
+
 	puppet_i2c_init();
 
 	// For now, the `gpio` param is ignored and all enabled GPIOs generate the irq
@@ -51,8 +64,10 @@ int main(void)
 	printf("Starting main loop\r\n");
 #endif
 
+	// the irqs leave everything that takes a while to the work queue
 	while (true) {
-		__wfe();
+		if (!work_run())
+			power_wait();
 	}
 
 	return 0;
@@ -0,0 +1,63 @@
+#include "perf.h"
+
+#if PERF_COUNTERS
+
+#include <hardware/sync.h>
+#include <pico/stdlib.h>
+
+// every timer is only updated from one context, the main loop or its own irq handler, and the irq handlers don't
+// nest. the counters are bumped from both, see perf_count.
+static struct
+{
+	uint32_t counters[PERF_COUNTER_LAST];
+	struct perf_timer_stats timers[PERF_TIMER_LAST];
+} self;
+
+// an irq between the load and the store of the increment would lose its own count otherwise
+void perf_count(enum perf_counter counter)
+{
+	const uint32_t irq = save_and_disable_interrupts();
+	++self.counters[counter];
+	restore_interrupts(irq);
+}
+
+void perf_time(enum perf_timer timer, uint32_t start_time)
+{
+	const uint32_t duration = time_us_32() - start_time;
+	struct perf_timer_stats *stats = &self.timers[timer];
+
+	if (!stats->count || (duration < stats->min_us))
+		stats->min_us = duration;
+
+	stats->max_us = MAX(stats->max_us, duration);
+	stats->total_us += duration;
+	++stats->count;
+}
+
+uint32_t perf_get_count(enum perf_counter counter)
+{
+	return self.counters[counter];
+}
+
+// the irq timers may change halfway through the copy otherwise
+void perf_get_timer(enum perf_timer timer, struct perf_timer_stats *stats)
+{
+	const uint32_t irq = save_and_disable_interrupts();
+	*stats = self.timers[timer];
+	restore_interrupts(irq);
+}
+
+void perf_reset(void)
+{
+	const uint32_t irq = save_and_disable_interrupts();
+
+	for (uint8_t i = 0; i < PERF_COUNTER_LAST; ++i)
+		self.counters[i] = 0;
+
+	for (uint8_t i = 0; i < PERF_TIMER_LAST; ++i)
+		self.timers[i] = (struct perf_timer_stats){ 0 };
+
+	restore_interrupts(irq);
+}
+
+#endif
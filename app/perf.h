@@ -0,0 +1,61 @@
+#pragma once
+
+#include <hardware/timer.h>
+#include <stdint.h>
+
+// Field counters for correlating latency reports with what the firmware did. Built with PERF_COUNTERS=0 every
+// call below is an empty inline and REG_PFV doesn't reply.
+
+enum perf_counter
+{
+	PERF_I2C_PACKETS = 0,		// register accesses served over the puppet I2C
+	PERF_USB_REPORTS_SENT,		// HID reports handed to the usb stack
+	PERF_USB_REPORTS_DROPPED,	// HID reports lost because a queue was full
+	PERF_FIFO_OVERFLOWS,		// key events that found REG_FIF full
+	PERF_INT_PULSES,			// pulses on the INT pin
+
+	PERF_COUNTER_LAST,
+};
+
+enum perf_timer
+{
+	PERF_TIMER_SCAN = 0,		// one keyboard scan
+	PERF_TIMER_PUPPET_IRQ,		// the puppet I2C irq handler
+	PERF_TIMER_TOUCH_IRQ,		// the trackpad motion irq
+	PERF_TIMER_TOUCH_READ,		// reading the trackpad motion in the main loop
+
+	PERF_TIMER_LAST,
+};
+
+struct perf_timer_stats
+{
+	uint32_t count;
+	uint32_t min_us;
+	uint32_t max_us;
+	uint64_t total_us;
+};
+
+#if PERF_COUNTERS
+
+static inline uint32_t perf_start(void)
+{
+	return time_us_32();
+}
+
+void perf_count(enum perf_counter counter);
+
+// records the time since start_time, from perf_start()
+void perf_time(enum perf_timer timer, uint32_t start_time);
+
+uint32_t perf_get_count(enum perf_counter counter);
+void perf_get_timer(enum perf_timer timer, struct perf_timer_stats *stats);
+
+void perf_reset(void);
+
+#else
+
+static inline uint32_t perf_start(void) { return 0; }
+static inline void perf_count(enum perf_counter counter) { (void)counter; }
+static inline void perf_time(enum perf_timer timer, uint32_t start_time) { (void)timer; (void)start_time; }
+
+#endif
@@ -0,0 +1,138 @@
+#include "pointer.h"
+
+#include "events.h"
+#include "reg.h"
+#include "work.h"
+
+#include <pico/stdlib.h>
+#include <stdlib.h>
+
+// All the math is done in Q8 (1/256 of a count), the M0+ has no FPU
+#define Q8_ONE				256
+#define GAIN_ONE			16  // gain registers are Q4, 16 is 1.0x
+#define IDLE_RESET_MS		100 // after this long without motion the stroke is over, what's left of it goes out
+#define MAX_CARRY			(4 * INT8_MAX * Q8_ONE) // most the output can fall behind the motion, in Q8
+
+static struct
+{
+	int32_t filt_x;
+	int32_t filt_y;
+	int32_t lag_x;	// motion that went into the filter but hasn't come out of it yet, Q8
+	int32_t lag_y;
+	int32_t rem_x;
+	int32_t rem_y;
+	int32_t gain;
+	uint32_t last_time;
+	bool idle_alarm_pending;
+} self;
+
+// piecewise linear: flat low gain, ramp between the two speeds, flat high gain
+static int32_t curve_gain(int32_t speed)
+{
+	const int32_t gain_low = reg_get_value(REG_ID_PGL);
+	const int32_t gain_high = reg_get_value(REG_ID_PGH);
+	const int32_t speed_low = reg_get_value(REG_ID_PSL);
+	const int32_t speed_high = reg_get_value(REG_ID_PSH);
+
+	if (speed <= speed_low)
+		return gain_low;
+
+	if (speed >= speed_high)
+		return gain_high;
+
+	return gain_low + ((gain_high - gain_low) * (speed - speed_low)) / (speed_high - speed_low);
+}
+
+static int8_t carry_out(int32_t value, int32_t *rem)
+{
+	value += *rem;
+
+	// truncate towards zero so the residual is symmetric for both directions
+	const int32_t out = MAX(INT8_MIN, MIN(value / Q8_ONE, INT8_MAX));
+
+	// anything beyond the clamp goes out with the next reports
+	*rem = MAX(-MAX_CARRY, MIN(value - (out * Q8_ONE), MAX_CARRY));
+
+	return out;
+}
+
+static int64_t idle_task(alarm_id_t id, void *user_data);
+
+static void stroke_end_work(uint32_t arg)
+{
+	(void)arg;
+
+	// motion came in after the alarm went off, the stroke goes on
+	const uint32_t idle = to_ms_since_boot(get_absolute_time()) - self.last_time;
+	if (idle < IDLE_RESET_MS) {
+		self.idle_alarm_pending = (add_alarm_in_ms(IDLE_RESET_MS - idle, idle_task, NULL, true) > 0);
+		return;
+	}
+
+	self.idle_alarm_pending = false;
+
+	// the motion still in the filter goes out at the gain the stroke ended with, so none of it is lost
+	self.rem_x += (self.lag_x * self.gain) / GAIN_ONE;
+	self.rem_y += (self.lag_y * self.gain) / GAIN_ONE;
+
+	while ((abs(self.rem_x) >= Q8_ONE) || (abs(self.rem_y) >= Q8_ONE)) {
+		const int8_t x = carry_out(0, &self.rem_x);
+		const int8_t y = carry_out(0, &self.rem_y);
+
+		events_touch(x, y);
+	}
+
+	// the next stroke starts from a clean state
+	self.filt_x = 0;
+	self.filt_y = 0;
+	self.lag_x = 0;
+	self.lag_y = 0;
+	self.rem_x = 0;
+	self.rem_y = 0;
+}
+
+static int64_t idle_task(alarm_id_t id, void *user_data)
+{
+	(void)id;
+	(void)user_data;
+
+	const uint32_t idle = to_ms_since_boot(get_absolute_time()) - self.last_time;
+	if (idle < IDLE_RESET_MS)
+		return -(int64_t)(IDLE_RESET_MS - idle) * 1000;
+
+	// the rest of the stroke goes out through the callbacks, those run in the main loop
+	if (!work_post(WORK_PRIO_NORMAL, stroke_end_work, 0))
+		return IDLE_RESET_MS * 1000;
+
+	return 0;
+}
+
+bool pointer_process(int8_t *x, int8_t *y)
+{
+	if (!reg_is_bit_set(REG_ID_CF2, CF2_TOUCH_ACCEL))
+		return true;
+
+	self.last_time = to_ms_since_boot(get_absolute_time());
+
+	if (!self.idle_alarm_pending)
+		self.idle_alarm_pending = (add_alarm_in_ms(IDLE_RESET_MS, idle_task, NULL, true) > 0);
+
+	// single pole low-pass, PSM is the weight of the previous value out of 256
+	const int32_t weight = reg_get_value(REG_ID_PSM);
+	self.filt_x = ((*x * Q8_ONE) * (Q8_ONE - weight) + self.filt_x * weight) / Q8_ONE;
+	self.filt_y = ((*y * Q8_ONE) * (Q8_ONE - weight) + self.filt_y * weight) / Q8_ONE;
+	self.lag_x += (*x * Q8_ONE) - self.filt_x;
+	self.lag_y += (*y * Q8_ONE) - self.filt_y;
+
+	// cheap magnitude estimate, max + min/2 is within ~12% of the real thing
+	const int32_t abs_x = abs(self.filt_x);
+	const int32_t abs_y = abs(self.filt_y);
+	const int32_t speed = (MAX(abs_x, abs_y) + (MIN(abs_x, abs_y) / 2)) / Q8_ONE;
+
+	self.gain = curve_gain(speed);
+
+	*x = carry_out((self.filt_x * self.gain) / GAIN_ONE, &self.rem_x);
+	*y = carry_out((self.filt_y * self.gain) / GAIN_ONE, &self.rem_y);
+
+	return (*x != 0) || (*y != 0);
+}
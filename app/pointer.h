@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// runs the touch deltas through the acceleration/smoothing pipeline when CF2_TOUCH_ACCEL is set,
+// returns false if there's nothing left to report (motion is being carried over to the next report),
+// whatever is still carried over when the motion stops is raised as touch events of its own
+bool pointer_process(int8_t *x, int8_t *y);
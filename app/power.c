@@ -0,0 +1,457 @@
+#include "power.h"
+
+#include "events.h"
+#include "gesture.h"
+#include "keyboard.h"
+#include "reg.h"
+#include "work.h"
+
+#include "puppet_i2c.h"
+
+#include <hardware/clocks.h>
+#include <hardware/pll.h>
+#include <hardware/sync.h>
+#include <hardware/uart.h>
+#include <hardware/vreg.h>
+#include <hardware/xosc.h>
+#include <pico/stdlib.h>
+#include <tusb.h>
+
+#ifndef USB_CLK_KHZ
+#define USB_CLK_KHZ				48000
+#endif
+
+// the usb PLL's clock, so the system PLL can be off while the clock is low. The puppet I2C only needs a few MHz
+// at 100 kHz, and its hold and spike filter counts were set at the full clock, so they only get longer down here.
+#define CLOCK_LOW_KHZ			USB_CLK_KHZ
+#define CLOCK_HOLD_MS			100  // time without activity before the clock goes down
+#define CLOCK_RETRY_MS			1    // the puppet I2C was in the middle of a transfer, try again after this
+#define POST_RETRY_MS			1    // the work queue was full, try again after this
+#define VREG_LOW_VOLTAGE		VREG_VOLTAGE_1_00
+#define VREG_SETTLE_US			1000 // there's no ready flag, give the regulator time before the clock comes back up
+
+static struct
+{
+	enum power_state state;
+	bool dormant_requested;
+	bool activity_posted;
+
+	uint32_t last_activity_time;
+	alarm_id_t idle_alarm;
+
+	// the full clock as set up at boot, and the PLL settings to get it back
+	uint32_t full_khz;
+	uint vco_freq;
+	uint post_div1;
+	uint post_div2;
+
+	bool clock_low;
+	bool vreg_low;
+	alarm_id_t clock_alarm;
+	struct power_clock_stats clock_stats;
+
+	uint64_t state_start_time;
+	uint64_t time_us[POWER_STATE_LAST];
+	struct power_stats stats;
+} self;
+
+static void account(void)
+{
+	const uint64_t now = time_us_64();
+
+	self.time_us[self.state] += now - self.state_start_time;
+	self.state_start_time = now;
+}
+
+static void set_state(enum power_state state)
+{
+	account();
+
+	self.state = state;
+
+	events_power(state);
+}
+
+static void notify_clock(void)
+{
+	self.clock_stats.khz = clock_get_hz(clk_sys) / 1000;
+
+	events_clock(clock_get_hz(clk_sys));
+}
+
+// clk_peri stays on the usb PLL, so the UART doesn't care about clk_sys changes
+static void setup_peri_clock(void)
+{
+	clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, USB_CLK_KHZ * KHZ, USB_CLK_KHZ * KHZ);
+
+#if !defined(NDEBUG) && LIB_PICO_STDIO_UART
+	uart_set_baudrate(uart_default, PICO_DEFAULT_UART_BAUD_RATE);
+#endif
+}
+
+static void set_clock_low(bool low)
+{
+	if (low == self.clock_low)
+		return;
+
+	if (low) {
+		clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX, CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB,
+			CLOCK_LOW_KHZ * KHZ, CLOCK_LOW_KHZ * KHZ);
+		pll_deinit(pll_sys);
+
+		if (reg_is_bit_set(REG_ID_PCF, PCF_VREG_SCALE_ON)) {
+			vreg_set_voltage(VREG_LOW_VOLTAGE);
+			self.vreg_low = true;
+		}
+
+		++self.clock_stats.lowered;
+	} else {
+		if (self.vreg_low) {
+			vreg_set_voltage(VREG_VOLTAGE_DEFAULT);
+			busy_wait_us(VREG_SETTLE_US);
+			self.vreg_low = false;
+		}
+
+		pll_init(pll_sys, 1, self.vco_freq, self.post_div1, self.post_div2);
+		clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX, CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS,
+			self.full_khz * KHZ, self.full_khz * KHZ);
+
+		++self.clock_stats.raised;
+	}
+
+	self.clock_low = low;
+
+	notify_clock();
+}
+
+static int64_t clock_task(alarm_id_t id, void *user_data);
+
+static void clock_low_work(uint32_t arg)
+{
+	(void)arg;
+
+	// activity since the alarm went off restarted it already
+	if (self.clock_alarm || !reg_is_bit_set(REG_ID_PCF, PCF_SLOW_CLK_ON))
+		return;
+
+	if (puppet_i2c_is_busy()) {
+		++self.clock_stats.deferred;
+		self.clock_alarm = MAX(add_alarm_in_ms(CLOCK_RETRY_MS, clock_task, NULL, true), 0);
+		return;
+	}
+
+	set_clock_low(true);
+}
+
+static int64_t clock_task(alarm_id_t id, void *user_data)
+{
+	(void)id;
+	(void)user_data;
+
+	const uint32_t idle = to_ms_since_boot(get_absolute_time()) - self.last_activity_time;
+	if (idle < CLOCK_HOLD_MS)
+		return (int64_t)(CLOCK_HOLD_MS - idle) * 1000;
+
+	// relocking the PLL and the clock callbacks take a while, the switch happens in the main loop
+	if (!work_post(WORK_PRIO_NORMAL, clock_low_work, 0))
+		return POST_RETRY_MS * 1000;
+
+	self.clock_alarm = 0;
+
+	return 0;
+}
+
+static void restart_clock_timer(void)
+{
+	if (self.clock_alarm)
+		cancel_alarm(self.clock_alarm);
+
+	self.clock_alarm = 0;
+
+	if (!reg_is_bit_set(REG_ID_PCF, PCF_SLOW_CLK_ON) || self.clock_low)
+		return;
+
+	const alarm_id_t alarm = add_alarm_in_ms(CLOCK_HOLD_MS, clock_task, NULL, true);
+
+	self.clock_alarm = MAX(alarm, 0);
+}
+
+static void wake(uint32_t start_time)
+{
+	self.dormant_requested = false;
+
+	set_state(POWER_ACTIVE);
+
+	const uint32_t latency = time_us_32() - start_time;
+
+	++self.stats.wakeups;
+	self.stats.latency_last_us = latency;
+	self.stats.latency_max_us = MAX(self.stats.latency_max_us, latency);
+}
+
+static void dormant(void)
+{
+	const uint32_t irq = save_and_disable_interrupts();
+
+	// something woke it up since the request, or left work for the main loop
+	if (!self.dormant_requested || (self.state == POWER_ACTIVE) || work_pending()) {
+		restore_interrupts(irq);
+		return;
+	}
+
+	set_state(POWER_DORMANT);
+
+	// the listeners armed their own pins, these two belong to the board
+	gpio_set_dormant_irq_enabled(PIN_TP_MOTION, GPIO_IRQ_EDGE_FALL, true);
+	gpio_set_dormant_irq_enabled(PIN_PUPPET_SDA, GPIO_IRQ_EDGE_FALL, true);
+
+	// clocks_init brings the clock back at full speed, that needs the full voltage
+	if (self.vreg_low) {
+		vreg_set_voltage(VREG_VOLTAGE_DEFAULT);
+		self.vreg_low = false;
+	}
+
+	// the PLLs lose their reference with the crystal, run straight from it until it stops
+	clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLK_REF, 0, XOSC_MHZ * MHZ, XOSC_MHZ * MHZ);
+	clock_stop(clk_usb);
+	clock_stop(clk_adc);
+	clock_stop(clk_rtc);
+	pll_deinit(pll_sys);
+	pll_deinit(pll_usb);
+
+	xosc_dormant();
+
+	// the timer picks up where it stopped, so the time spent dormant isn't counted anywhere
+	const uint32_t start_time = time_us_32();
+	self.state_start_time = time_us_64();
+
+	clocks_init();
+	setup_peri_clock();
+
+	if (self.clock_low) {
+		self.clock_low = false;
+		++self.clock_stats.raised;
+	}
+
+	notify_clock();
+
+	gpio_set_dormant_irq_enabled(PIN_TP_MOTION, GPIO_IRQ_EDGE_FALL, false);
+	gpio_set_dormant_irq_enabled(PIN_PUPPET_SDA, GPIO_IRQ_EDGE_FALL, false);
+	gpio_acknowledge_irq(PIN_TP_MOTION, GPIO_IRQ_EDGE_FALL);
+	gpio_acknowledge_irq(PIN_PUPPET_SDA, GPIO_IRQ_EDGE_FALL);
+
+	++self.stats.dormant_wakeups;
+	self.last_activity_time = to_ms_since_boot(get_absolute_time());
+
+	wake(start_time);
+
+	restore_interrupts(irq);
+
+	power_sync();
+}
+
+static void enter_sleep(void)
+{
+	// usb is still alive with the lowered clock, running the system from its PLL is what keeps it that way
+	if (reg_is_bit_set(REG_ID_PCF, PCF_SLOW_CLK_ON)) {
+		set_clock_low(true);
+		set_state(POWER_SLOW);
+	} else {
+		set_state(POWER_IDLE);
+	}
+
+	// the usb pins can't wake it from dormant, so only go there without a host
+	if (reg_is_bit_set(REG_ID_PCF, PCF_DORMANT_ON) && !tud_mounted() && (self.state == POWER_SLOW))
+		self.dormant_requested = true;
+}
+
+static void sleep_work(uint32_t arg)
+{
+	(void)arg;
+
+	// activity since the alarm went off restarted it already
+	if (self.idle_alarm || !reg_get_value(REG_ID_PIT) || (self.state != POWER_ACTIVE))
+		return;
+
+	enter_sleep();
+}
+
+static int64_t idle_task(alarm_id_t id, void *user_data)
+{
+	(void)id;
+	(void)user_data;
+
+	const uint32_t timeout = reg_get_value(REG_ID_PIT) * 1000;
+	const uint32_t idle = to_ms_since_boot(get_absolute_time()) - self.last_activity_time;
+
+	if (timeout && (idle < timeout))
+		return (int64_t)(timeout - idle) * 1000;
+
+	// the power callbacks stop the scan and the timers, that happens in the main loop
+	if (timeout && (self.state == POWER_ACTIVE) && !work_post(WORK_PRIO_NORMAL, sleep_work, 0))
+		return POST_RETRY_MS * 1000;
+
+	self.idle_alarm = 0;
+
+	return 0;
+}
+
+static void restart_idle_timer(void)
+{
+	if (self.idle_alarm)
+		cancel_alarm(self.idle_alarm);
+
+	self.idle_alarm = 0;
+
+	const uint32_t timeout = reg_get_value(REG_ID_PIT) * 1000;
+	if (!timeout || (self.state != POWER_ACTIVE))
+		return;
+
+	const uint32_t idle = to_ms_since_boot(get_absolute_time()) - self.last_activity_time;
+	const alarm_id_t alarm = add_alarm_in_ms((idle < timeout) ? (timeout - idle) : 1, idle_task, NULL, true);
+
+	self.idle_alarm = MAX(alarm, 0);
+}
+
+static void activity(uint32_t start_time)
+{
+	self.last_activity_time = to_ms_since_boot(get_absolute_time());
+
+	// bursts of input run at the full clock
+	if (self.clock_low)
+		set_clock_low(false);
+
+	if (self.state != POWER_ACTIVE)
+		wake(start_time);
+
+	// while the alarms are pending they push themselves out to the last activity
+	if (!self.idle_alarm)
+		restart_idle_timer();
+
+	if (!self.clock_alarm)
+		restart_clock_timer();
+}
+
+void power_activity(void)
+{
+	activity(time_us_32());
+}
+
+static void activity_work(uint32_t arg)
+{
+	self.activity_posted = false;
+
+	// the wake up latency counts from the edge
+	activity(arg);
+}
+
+void power_key_cb(char key, enum key_state state)
+{
+	(void)key;
+	(void)state;
+
+	power_activity();
+}
+
+void power_touch_cb(int8_t x, int8_t y)
+{
+	(void)x;
+	(void)y;
+
+	power_activity();
+}
+
+void power_gesture_cb(enum gesture gesture, int8_t x, int8_t y)
+{
+	(void)gesture;
+	(void)x;
+	(void)y;
+
+	power_activity();
+}
+
+void power_gpio_irq(uint gpio, uint32_t events)
+{
+	(void)gpio;
+	(void)events;
+
+	// the row pins only raise an irq while the keyboard scan is stopped
+	if (!self.activity_posted)
+		self.activity_posted = work_post(WORK_PRIO_HIGH, activity_work, time_us_32());
+}
+
+void power_wait(void)
+{
+	if (self.dormant_requested)
+		dormant();
+
+	__wfe();
+}
+
+void power_sync(void)
+{
+	if (!reg_is_bit_set(REG_ID_PCF, PCF_SLOW_CLK_ON))
+		set_clock_low(false);
+
+	if (!reg_get_value(REG_ID_PIT) && (self.state != POWER_ACTIVE))
+		wake(time_us_32());
+
+	restart_idle_timer();
+	restart_clock_timer();
+}
+
+const struct power_stats *power_get_stats(void)
+{
+	const uint32_t irq = save_and_disable_interrupts();
+
+	account();
+
+	for (uint8_t i = 0; i < POWER_STATE_LAST; ++i)
+		self.stats.time_ms[i] = (uint32_t)(self.time_us[i] / 1000);
+
+	restore_interrupts(irq);
+
+	return &self.stats;
+}
+
+void power_reset_stats(void)
+{
+	const uint32_t irq = save_and_disable_interrupts();
+
+	account();
+
+	for (uint8_t i = 0; i < POWER_STATE_LAST; ++i)
+		self.time_us[i] = 0;
+
+	self.stats = (struct power_stats){ 0 };
+
+	self.clock_stats.raised = 0;
+	self.clock_stats.lowered = 0;
+	self.clock_stats.deferred = 0;
+
+	restore_interrupts(irq);
+}
+
+const struct power_clock_stats *power_get_clock_stats(void)
+{
+	return &self.clock_stats;
+}
+
+enum power_state power_get_state(void)
+{
+	return self.state;
+}
+
+void power_init(void)
+{
+	self.full_khz = clock_get_hz(clk_sys) / 1000;
+	check_sys_clock_khz(self.full_khz, &self.vco_freq, &self.post_div1, &self.post_div2);
+
+	setup_peri_clock();
+	notify_clock();
+
+	self.state_start_time = time_us_64();
+	self.last_activity_time = to_ms_since_boot(get_absolute_time());
+
+	power_sync();
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+enum power_state
+{
+	POWER_ACTIVE = 0,
+	POWER_IDLE,		// periodic timers stopped, waiting for a wake up
+	POWER_SLOW,		// as POWER_IDLE, with the system clock lowered and the system PLL off
+	POWER_DORMANT,	// every clock stopped until a wake pin edge
+
+	POWER_STATE_LAST,
+};
+
+struct power_stats
+{
+	uint32_t time_ms[POWER_STATE_LAST];	// time spent in each state, the timer doesn't run while dormant
+	uint32_t wakeups;
+	uint32_t dormant_wakeups;			// of those, the ones from dormant
+	uint32_t latency_last_us;			// time from the wake up to everything running again
+	uint32_t latency_max_us;
+};
+
+struct power_clock_stats
+{
+	uint32_t khz;		// current clk_sys
+	uint32_t raised;	// times the clock went back up for activity
+	uint32_t lowered;	// times the clock went down after CLOCK_HOLD_MS without activity
+	uint32_t deferred;	// times going down waited for a puppet I2C transfer to finish
+};
+
+// key, touch, host and GPIO activity, restarts the idle timeout and wakes the system up
+void power_activity(void);
+
+void power_gpio_irq(uint gpio, uint32_t events);
+
+// call from the main loop instead of __wfe once there's no work left, dormant mode is entered from here
+void power_wait(void);
+
+void power_sync(void);
+
+const struct power_stats *power_get_stats(void);
+void power_reset_stats(void);
+
+const struct power_clock_stats *power_get_clock_stats(void);
+
+enum power_state power_get_state(void);
+
+void power_init(void);
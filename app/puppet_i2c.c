@@ -1,12 +1,17 @@
 #include "puppet_i2c.h"
 
+#include "perf.h"
 #include "reg.h"
+#include "trace.h"
+#include "work.h"
 
 #include <hardware/i2c.h>
 #include <hardware/irq.h>
+#include <hardware/sync.h>
 #include <pico/stdlib.h>
 
 #define REG_ID_INVALID		0x00
+#define POST_RETRY_US		500 // how often a packet the work queue had no room for is posted again
 
 static i2c_inst_t *i2c_instances[2] = { i2c0, i2c1 };
 
@@ -20,45 +25,136 @@ static struct
 		uint8_t data;
 	} read_buffer;
 
-	uint8_t write_buffer[2];
+	uint8_t pending;	// packets posted to the main loop and not processed yet
+	bool read_waiting;	// the controller requested a read before they were, the clock is held low meanwhile
+	bool rx_held;		// the work queue was full, read_buffer keeps the packet and the rx fifo fills up meanwhile
+
+	uint8_t write_buffer[PACKET_OUT_MAX_LEN];
 	uint8_t write_len;
 } self;
 
-static void irq_handler(void)
+static void reply(void)
 {
-	// the controller sent data
-	if (self.i2c->hw->intr_stat & I2C_IC_INTR_MASK_M_RX_FULL_BITS) {
-		if (self.read_buffer.reg == REG_ID_INVALID) {
-			self.read_buffer.reg = self.i2c->hw->data_cmd & 0xff;
-
-			if (self.read_buffer.reg & PACKET_WRITE_MASK) {
-				// it'sq a reg write, we need to wait for the second byte before we process
-				return;
-			}
-		} else {
-			self.read_buffer.data = self.i2c->hw->data_cmd & 0xff;
+	i2c_write_raw_blocking(self.i2c, self.write_buffer, self.write_len);
+
+	self.i2c->hw->clr_rd_req;
+}
+
+static void packet_work(uint32_t arg)
+{
+	trace(TRACE_I2C, arg & 0xFF, (arg >> 8) & 0xFF);
+
+	reg_process_packet(arg & 0xFF, (arg >> 8) & 0xFF, self.write_buffer, &self.write_len);
+
+	perf_count(PERF_I2C_PACKETS);
+
+	const uint32_t irq = save_and_disable_interrupts();
+
+	--self.pending;
+
+	if (!self.pending && !self.rx_held && self.read_waiting) {
+		reply();
+
+		self.read_waiting = false;
+		hw_set_bits(&self.i2c->hw->intr_mask, I2C_IC_INTR_MASK_M_RD_REQ_BITS);
+	}
+
+	restore_interrupts(irq);
+}
+
+static bool post_packet(void)
+{
+	// processing may write flash or reset, that happens in the main loop
+	if (!work_post(WORK_PRIO_HIGH, packet_work, self.read_buffer.reg | (self.read_buffer.data << 8)))
+		return false;
+
+	++self.pending;
+
+	// ready for the next operation
+	self.read_buffer.reg = REG_ID_INVALID;
+
+	return true;
+}
+
+static int64_t post_retry_task(alarm_id_t id, void *user_data)
+{
+	(void)id;
+	(void)user_data;
+
+	if (!post_packet())
+		return POST_RETRY_US;
+
+	// whatever the controller sent meanwhile waited in the rx fifo, it raises the irq again
+	self.rx_held = false;
+	hw_set_bits(&self.i2c->hw->intr_mask, I2C_IC_INTR_MASK_M_RX_FULL_BITS);
+
+	return 0;
+}
+
+static void receive(void)
+{
+	if (self.read_buffer.reg == REG_ID_INVALID) {
+		self.read_buffer.reg = self.i2c->hw->data_cmd & 0xff;
+
+		if (self.read_buffer.reg & PACKET_WRITE_MASK) {
+			// it'sq a reg write, we need to wait for the second byte before we process
+			return;
 		}
+	} else {
+		self.read_buffer.data = self.i2c->hw->data_cmd & 0xff;
+	}
 
-		reg_process_packet(self.read_buffer.reg, self.read_buffer.data, self.write_buffer, &self.write_len);
+	if (post_packet())
+		return;
 
-		// ready for the next operation
-		self.read_buffer.reg = REG_ID_INVALID;
+	// no room in the work queue, keep the packet and leave the next bytes in the rx fifo instead of dropping the write.
+	// once the fifo is full the controller's clock is stretched, see puppet_i2c_sync_address.
+	self.rx_held = true;
+	hw_clear_bits(&self.i2c->hw->intr_mask, I2C_IC_INTR_MASK_M_RX_FULL_BITS);
+	add_alarm_in_us(POST_RETRY_US, post_retry_task, NULL, true);
+}
 
+static void read_request(void)
+{
+	// the reply isn't ready yet, the controller is held until packet_work has it
+	if (self.pending || self.rx_held) {
+		self.read_waiting = true;
+		hw_clear_bits(&self.i2c->hw->intr_mask, I2C_IC_INTR_MASK_M_RD_REQ_BITS);
 		return;
 	}
 
-	// the controller requested a read
-	if (self.i2c->hw->intr_stat & I2C_IC_INTR_MASK_M_RD_REQ_BITS) {
-		i2c_write_raw_blocking(self.i2c, self.write_buffer, self.write_len);
+	reply();
+}
 
-		self.i2c->hw->clr_rd_req;
-		return;
+static void irq_handler(void)
+{
+	const uint32_t start_time = time_us_32();
+
+	if (self.i2c->hw->intr_stat & I2C_IC_INTR_MASK_M_RX_FULL_BITS) {
+		// the controller sent data
+		receive();
+	} else if (self.i2c->hw->intr_stat & I2C_IC_INTR_MASK_M_RD_REQ_BITS) {
+		// the controller requested a read
+		read_request();
 	}
+
+	work_irq_done(start_time);
+	perf_time(PERF_TIMER_PUPPET_IRQ, start_time);
+}
+
+bool puppet_i2c_is_busy(void)
+{
+	return (self.read_buffer.reg != REG_ID_INVALID) || self.pending || (self.i2c->hw->status & I2C_IC_STATUS_SLV_ACTIVITY_BITS);
 }
 
 void puppet_i2c_sync_address(void)
 {
 	i2c_set_slave_mode(self.i2c, true, reg_get_value(REG_ID_ADR));
+
+	// hold SCL low when the rx fifo is full instead of overflowing it, IC_CON only takes writes while disabled
+	self.i2c->hw->enable = 0;
+	hw_set_bits(&self.i2c->hw->con, I2C_IC_CON_RX_FIFO_FULL_HLD_CTRL_BITS);
+	self.i2c->hw->enable = 1;
 }
 
 void puppet_i2c_init(void)
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <stdbool.h>
+
 void puppet_i2c_sync_address(void);
 
+bool puppet_i2c_is_busy(void); // a transfer with the controller is in progress
+
 void puppet_i2c_init(void);
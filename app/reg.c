@@ -2,12 +2,20 @@
 
 #include "app_config.h"
 #include "backlight.h"
+#include "events.h"
 #include "fifo.h"
+#include "gesture.h"
 #include "gpioexp.h"
 #include "puppet_i2c.h"
 #include "keyboard.h"
-#include "touchpad.h"
-
+#include "perf.h"
+#include "power.h"
+#include "settings.h"
+#include "trace.h"
+#include "usb.h"
+#include "work.h"
+
+#include <hardware/sync.h>
 #include <pico/stdlib.h>
 #include <RP2040.h> // TODO: When there's more than one RP chip, change this to be more generic
 #include <stdio.h>
@@ -18,18 +26,85 @@
 static struct
 {
 	uint8_t regs[REG_ID_LAST];
+
+	// scroll that didn't add up to a whole step yet
+	int16_t scroll_rem_x;
+	int16_t scroll_rem_y;
 } self;
 
-static void touch_cb(int8_t x, int8_t y)
+static void write_u32(uint8_t *buffer, uint32_t value)
 {
-	const int16_t dx = (int8_t)self.regs[REG_ID_TOX] + x;
-	const int16_t dy = (int8_t)self.regs[REG_ID_TOY] + y;
+	buffer[0] = (value >> 0) & 0xFF;
+	buffer[1] = (value >> 8) & 0xFF;
+	buffer[2] = (value >> 16) & 0xFF;
+	buffer[3] = (value >> 24) & 0xFF;
+}
+
+static void touch_acc8(enum reg_id reg, int8_t delta, uint8_t sat_bit)
+{
+	const int16_t val = (int8_t)self.regs[reg] + delta;
+
+	if ((val < INT8_MIN) || (val > INT8_MAX))
+		self.regs[REG_ID_TST] |= sat_bit;
 
 	// bind to -128 to 127
-	self.regs[REG_ID_TOX] = MAX(INT8_MIN, MIN(dx, INT8_MAX));
-	self.regs[REG_ID_TOY] = MAX(INT8_MIN, MIN(dy, INT8_MAX));
+	self.regs[reg] = MAX(INT8_MIN, MIN(val, INT8_MAX));
+}
+
+static void touch_acc16(enum reg_id reg_lo, int8_t delta, uint8_t sat_bit)
+{
+	const int32_t val = (int16_t)(self.regs[reg_lo] | (self.regs[reg_lo + 1] << 8)) + delta;
+
+	if ((val < INT16_MIN) || (val > INT16_MAX))
+		self.regs[REG_ID_TST] |= sat_bit;
+
+	// bind to -32768 to 32767
+	const uint16_t bound = (uint16_t)MAX(INT16_MIN, MIN(val, INT16_MAX));
+	self.regs[reg_lo] = bound & 0xFF;
+	self.regs[reg_lo + 1] = bound >> 8;
+}
+
+void reg_touch_cb(int8_t x, int8_t y)
+{
+	// a reader must never see half of an update
+	const uint32_t irq = save_and_disable_interrupts();
+
+	touch_acc8(REG_ID_TOX, x, TST_TOX_SAT);
+	touch_acc8(REG_ID_TOY, y, TST_TOY_SAT);
+
+	touch_acc16(REG_ID_TXL, x, TST_TX_SAT);
+	touch_acc16(REG_ID_TYL, y, TST_TY_SAT);
+
+	restore_interrupts(irq);
+}
+
+void reg_gesture_cb(enum gesture gesture, int8_t x, int8_t y)
+{
+	self.regs[REG_ID_GES] = gesture;
+
+	if (gesture != GESTURE_SCROLL)
+		return;
+
+	self.scroll_rem_x += x;
+	self.scroll_rem_y += y;
+
+	const int16_t steps_x = self.scroll_rem_x / GESTURE_SCROLL_RES;
+	const int16_t steps_y = self.scroll_rem_y / GESTURE_SCROLL_RES;
+
+	self.scroll_rem_x -= steps_x * GESTURE_SCROLL_RES;
+	self.scroll_rem_y -= steps_y * GESTURE_SCROLL_RES;
+
+	const uint32_t irq = save_and_disable_interrupts();
+
+	const int16_t dx = (int8_t)self.regs[REG_ID_GSX] + steps_x;
+	const int16_t dy = (int8_t)self.regs[REG_ID_GSY] + steps_y;
+
+	// bind to -128 to 127
+	self.regs[REG_ID_GSX] = MAX(INT8_MIN, MIN(dx, INT8_MAX));
+	self.regs[REG_ID_GSY] = MAX(INT8_MIN, MIN(dy, INT8_MAX));
+
+	restore_interrupts(irq);
 }
-static struct touch_callback touch_callback = { .func = touch_cb };
 
 void reg_process_packet(uint8_t in_reg, uint8_t in_data, uint8_t *out_buffer, uint8_t *out_len)
 {
@@ -44,17 +119,34 @@ void reg_process_packet(uint8_t in_reg, uint8_t in_data, uint8_t *out_buffer, ui
 
 	// common R/W registers
 	case REG_ID_CFG:
-	case REG_ID_INT:
 	case REG_ID_DEB:
 	case REG_ID_FRQ:
 	case REG_ID_BKL:
 	case REG_ID_BK2:
 	case REG_ID_GIC:
-	case REG_ID_GIN:
 	case REG_ID_HLD:
 	case REG_ID_ADR:
 	case REG_ID_IND:
 	case REG_ID_CF2:
+	case REG_ID_GCF:
+	case REG_ID_SWT:
+	case REG_ID_SWO:
+	case REG_ID_PGL:
+	case REG_ID_PGH:
+	case REG_ID_PSL:
+	case REG_ID_PSH:
+	case REG_ID_PSM:
+	case REG_ID_MPI:
+	case REG_ID_GEC:
+	case REG_ID_GPS:
+	case REG_ID_BFT:
+	case REG_ID_BCF:
+	case REG_ID_BIT:
+	case REG_ID_BIL:
+	case REG_ID_PIT:
+	case REG_ID_PCF:
+	case REG_ID_PFS:
+	case REG_ID_TRC:
 	{
 		if (is_write) {
 			reg_set_value(reg, in_data);
@@ -62,6 +154,10 @@ void reg_process_packet(uint8_t in_reg, uint8_t in_data, uint8_t *out_buffer, ui
 			switch (reg) {
 			case REG_ID_BKL:
 			case REG_ID_BK2:
+			case REG_ID_BFT:
+			case REG_ID_BCF:
+			case REG_ID_BIT:
+			case REG_ID_BIL:
 				backlight_sync();
 				break;
 
@@ -69,6 +165,15 @@ void reg_process_packet(uint8_t in_reg, uint8_t in_data, uint8_t *out_buffer, ui
 				puppet_i2c_sync_address();
 				break;
 
+			case REG_ID_MPI:
+				usb_reenumerate();
+				break;
+
+			case REG_ID_PIT:
+			case REG_ID_PCF:
+				power_sync();
+				break;
+
 			default:
 				break;
 			}
@@ -79,6 +184,23 @@ void reg_process_packet(uint8_t in_reg, uint8_t in_data, uint8_t *out_buffer, ui
 		break;
 	}
 
+	// interrupt status registers, set from the irqs and cleared by the host
+	case REG_ID_INT:
+	case REG_ID_GIN:
+	{
+		if (is_write) {
+			// with W1C only the bits written as 1 are cleared, so flags raised after the host read the register survive
+			if (reg_is_bit_set(REG_ID_CF2, CF2_INT_W1C))
+				reg_clear_bit(reg, in_data);
+			else
+				reg_set_value(reg, in_data);
+		} else {
+			out_buffer[0] = reg_is_bit_set(REG_ID_CF2, CF2_INT_RC) ? reg_take_value(reg) : reg_get_value(reg);
+			*out_len = sizeof(uint8_t);
+		}
+		break;
+	}
+
 	// special R/W registers
 	case REG_ID_DIR: // gpio direction
 	case REG_ID_PUE: // gpio input pull enable
@@ -103,6 +225,204 @@ void reg_process_packet(uint8_t in_reg, uint8_t in_data, uint8_t *out_buffer, ui
 		break;
 	}
 
+	case REG_ID_PST:
+	{
+		if (is_write) {
+			power_reset_stats();
+		} else {
+			const struct power_stats *stats = power_get_stats();
+
+			out_buffer[0] = power_get_state();
+			write_u32(&out_buffer[1], stats->time_ms[POWER_ACTIVE]);
+			write_u32(&out_buffer[5], stats->time_ms[POWER_IDLE]);
+			write_u32(&out_buffer[9], stats->time_ms[POWER_SLOW]);
+			*out_len = sizeof(uint8_t) + sizeof(uint32_t) * 3;
+		}
+		break;
+	}
+
+	case REG_ID_PWS:
+	{
+		const struct power_stats *stats = power_get_stats();
+
+		write_u32(&out_buffer[0], stats->wakeups);
+		write_u32(&out_buffer[4], stats->dormant_wakeups);
+		write_u32(&out_buffer[8], stats->latency_last_us);
+		write_u32(&out_buffer[12], stats->latency_max_us);
+		*out_len = sizeof(uint32_t) * 4;
+		break;
+	}
+
+	case REG_ID_PCK:
+	{
+		const struct power_clock_stats *stats = power_get_clock_stats();
+
+		write_u32(&out_buffer[0], stats->khz);
+		write_u32(&out_buffer[4], stats->raised);
+		write_u32(&out_buffer[8], stats->lowered);
+		write_u32(&out_buffer[12], stats->deferred);
+		*out_len = sizeof(uint32_t) * 4;
+		break;
+	}
+
+	case REG_ID_WQS:
+	{
+		if (is_write) {
+			work_reset_stats();
+		} else {
+			const struct work_stats *stats = work_get_stats();
+
+			write_u32(&out_buffer[0], stats->latency_max_us);
+			write_u32(&out_buffer[4], stats->run_max_us);
+			write_u32(&out_buffer[8], stats->irq_max_us);
+			write_u32(&out_buffer[12], stats->dropped);
+			*out_len = sizeof(uint32_t) * 4;
+		}
+		break;
+	}
+
+#if PERF_COUNTERS
+	case REG_ID_PFV:
+	{
+		const uint8_t idx = reg_get_value(REG_ID_PFS);
+
+		if (is_write) {
+			perf_reset();
+		} else if (idx == PFS_UPTIME) {
+			const uint64_t uptime = time_us_64() / 1000;
+
+			write_u32(&out_buffer[0], (uint32_t)uptime);
+			write_u32(&out_buffer[4], (uint32_t)(uptime >> 32));
+			*out_len = sizeof(uint64_t);
+		} else if ((idx >= PFS_COUNTER) && (idx < PFS_COUNTER + PERF_COUNTER_LAST)) {
+			write_u32(&out_buffer[0], perf_get_count(idx - PFS_COUNTER));
+			*out_len = sizeof(uint32_t);
+		} else if ((idx >= PFS_TIMER) && (idx < PFS_TIMER + PERF_TIMER_LAST)) {
+			struct perf_timer_stats stats;
+			perf_get_timer(idx - PFS_TIMER, &stats);
+
+			write_u32(&out_buffer[0], stats.count);
+			write_u32(&out_buffer[4], stats.min_us);
+			write_u32(&out_buffer[8], stats.count ? (uint32_t)(stats.total_us / stats.count) : 0);
+			write_u32(&out_buffer[12], stats.max_us);
+			*out_len = sizeof(uint32_t) * 4;
+		}
+		break;
+	}
+#endif
+
+#if TRACE_RING
+	case REG_ID_TRD:
+	{
+		if (is_write) {
+			trace_clear();
+			break;
+		}
+
+		struct trace_record record;
+		uint8_t count = 0;
+
+		while ((count < TRD_MAX_RECORDS) && trace_pop(&record)) {
+			uint8_t *out = &out_buffer[1 + (count * TRD_RECORD_LEN)];
+
+			write_u32(&out[0], record.time);
+			out[4] = record.type;
+			out[5] = record.a;
+			out[6] = record.b;
+			++count;
+		}
+
+		out_buffer[0] = count;
+		out_buffer[0] |= trace_count()         ? TRD_MORE     : 0x00;
+		out_buffer[0] |= trace_take_overflow() ? TRD_OVERFLOW : 0x00;
+		*out_len = 1 + (count * TRD_RECORD_LEN);
+		break;
+	}
+#endif
+
+	case REG_ID_CFS: // config store
+	{
+		if (is_write) {
+			if (in_data == CFS_SAVE)
+				settings_save();
+			else if (in_data == CFS_DEFAULTS)
+				settings_clear();
+		} else {
+			out_buffer[0] = 0;
+			out_buffer[0] |= settings_saved()  ? CFS_SAVED  : 0x00;
+			out_buffer[0] |= settings_busy()   ? CFS_BUSY   : 0x00;
+			out_buffer[0] |= settings_failed() ? CFS_FAILED : 0x00;
+			*out_len = sizeof(uint8_t);
+		}
+		break;
+	}
+
+	// per pin registers, for the pin selected in GPS
+	case REG_ID_GPM:
+	case REG_ID_GPD:
+	case REG_ID_GFL:
+	case REG_ID_GFH:
+	case REG_ID_GGF:
+	{
+		const uint8_t idx = reg_get_value(REG_ID_GPS);
+		const uint16_t freq = gpioexp_get_pwm_freq(idx);
+		const uint8_t duty = gpioexp_get_pwm_duty(idx);
+
+		if (is_write) {
+			switch (reg) {
+			case REG_ID_GPM:
+				gpioexp_set_mode(idx, in_data);
+				break;
+			case REG_ID_GPD:
+				gpioexp_set_pwm(idx, freq, in_data);
+				break;
+			case REG_ID_GFL:
+				gpioexp_set_pwm(idx, (freq & 0xFF00) | in_data, duty);
+				break;
+			case REG_ID_GFH:
+				gpioexp_set_pwm(idx, (freq & 0x00FF) | (in_data << 8), duty);
+				break;
+			case REG_ID_GGF:
+				gpioexp_set_filter(idx, in_data);
+				break;
+			}
+		} else {
+			switch (reg) {
+			case REG_ID_GPM:
+				out_buffer[0] = gpioexp_get_mode(idx) | (gpioexp_was_refused(idx) ? GPM_REFUSED : 0);
+				break;
+			case REG_ID_GPD:
+				out_buffer[0] = duty;
+				break;
+			case REG_ID_GFL:
+				out_buffer[0] = freq & 0xFF;
+				break;
+			case REG_ID_GFH:
+				out_buffer[0] = freq >> 8;
+				break;
+			case REG_ID_GGF:
+				out_buffer[0] = gpioexp_get_filter(idx);
+				break;
+			}
+			*out_len = sizeof(uint8_t);
+		}
+		break;
+	}
+
+	case REG_ID_GCN:
+	{
+		const uint8_t idx = reg_get_value(REG_ID_GPS);
+
+		if (is_write) {
+			gpioexp_reset_count(idx);
+		} else {
+			write_u32(&out_buffer[0], gpioexp_get_count(idx));
+			write_u32(&out_buffer[4], gpioexp_get_count_freq(idx));
+			*out_len = sizeof(uint32_t) * 2;
+		}
+		break;
+	}
+
 	case REG_ID_GIO: // gpio value
 	{
 		if (is_write) {
@@ -117,10 +437,44 @@ void reg_process_packet(uint8_t in_reg, uint8_t in_data, uint8_t *out_buffer, ui
 	// read-only registers
 	case REG_ID_TOX:
 	case REG_ID_TOY:
+		out_buffer[0] = reg_take_value(reg);
+		*out_len = sizeof(uint8_t);
+
+		reg_clear_bit(REG_ID_TST, (reg == REG_ID_TOX) ? TST_TOX_SAT : TST_TOY_SAT);
+		break;
+
+	case REG_ID_TXL:
+	{
+		const uint32_t irq = save_and_disable_interrupts();
+
+		// the whole x/y pair is returned at once so the host never sees half of an update
+		for (uint8_t i = 0; i <= (REG_ID_TST - REG_ID_TXL); ++i) {
+			out_buffer[i] = reg_get_value(REG_ID_TXL + i);
+
+			if ((REG_ID_TXL + i) != REG_ID_TST)
+				reg_set_value(REG_ID_TXL + i, 0);
+		}
+		*out_len = (REG_ID_TST - REG_ID_TXL) + 1;
+
+		reg_clear_bit(REG_ID_TST, TST_TX_SAT | TST_TY_SAT);
+
+		restore_interrupts(irq);
+		break;
+	}
+
+	case REG_ID_TXH:
+	case REG_ID_TYL:
+	case REG_ID_TYH:
+	case REG_ID_TST:
 		out_buffer[0] = reg_get_value(reg);
 		*out_len = sizeof(uint8_t);
+		break;
 
-		reg_set_value(reg, 0);
+	case REG_ID_GES:
+	case REG_ID_GSX:
+	case REG_ID_GSY:
+		out_buffer[0] = reg_take_value(reg);
+		*out_len = sizeof(uint8_t);
 		break;
 
 	case REG_ID_VER:
@@ -145,10 +499,149 @@ void reg_process_packet(uint8_t in_reg, uint8_t in_data, uint8_t *out_buffer, ui
 		break;
 	}
 
+	case REG_ID_GEV:
+	{
+		struct gpioexp_event event;
+		uint8_t count = 0;
+
+		while ((count < GEV_MAX_EVENTS) && gpioexp_pop_event(&event)) {
+			uint8_t *out = &out_buffer[1 + (count * GEV_EVENT_LEN)];
+
+			out[0] = event.gpio_idx | (event.level ? (1 << 7) : 0);
+			write_u32(&out[1], event.time);
+			++count;
+		}
+
+		out_buffer[0] = count;
+		out_buffer[0] |= gpioexp_event_count()         ? GEV_MORE     : 0x00;
+		out_buffer[0] |= gpioexp_take_event_overflow() ? GEV_OVERFLOW : 0x00;
+		*out_len = 1 + (count * GEV_EVENT_LEN);
+		break;
+	}
+
+	case REG_ID_HQS:
+	{
+		const struct usb_report_stats *stats = usb_get_report_stats();
+
+		write_u32(&out_buffer[0], stats->queued);
+		write_u32(&out_buffer[4], stats->merged);
+		write_u32(&out_buffer[8], stats->dropped);
+		*out_len = sizeof(uint32_t) * 3;
+		break;
+	}
+
+	case REG_ID_UTS:
+	{
+		const struct usb_task_stats *stats = usb_get_task_stats();
+
+		write_u32(&out_buffer[0], stats->wakeups);
+		write_u32(&out_buffer[4], stats->timer_wakeups);
+		write_u32(&out_buffer[8], stats->latency_max_us);
+		write_u32(&out_buffer[12], stats->latency_avg_us);
+		*out_len = sizeof(uint32_t) * 4;
+		break;
+	}
+
 	case REG_ID_RST:
 		NVIC_SystemReset();
 		break;
 	}
+
+	// host traffic keeps the system awake, after the access so REG_PST still shows the state it found
+	power_activity();
+}
+
+void reg_update_packet(uint8_t reg, uint8_t mask, uint8_t value, uint8_t *out_buffer, uint8_t *out_len)
+{
+	*out_len = 0;
+
+	switch (reg) {
+
+	// plain registers, the new value is written the same way the host would
+	case REG_ID_CFG:
+	case REG_ID_DEB:
+	case REG_ID_FRQ:
+	case REG_ID_BKL:
+	case REG_ID_BK2:
+	case REG_ID_DIR:
+	case REG_ID_PUE:
+	case REG_ID_PUD:
+	case REG_ID_GIC:
+	case REG_ID_HLD:
+	case REG_ID_ADR:
+	case REG_ID_IND:
+	case REG_ID_CF2:
+	case REG_ID_GCF:
+	case REG_ID_SWT:
+	case REG_ID_SWO:
+	case REG_ID_PGL:
+	case REG_ID_PGH:
+	case REG_ID_PSL:
+	case REG_ID_PSH:
+	case REG_ID_PSM:
+	case REG_ID_MPI:
+	case REG_ID_GEC:
+	case REG_ID_GPS:
+	case REG_ID_BFT:
+	case REG_ID_BCF:
+	case REG_ID_BIT:
+	case REG_ID_BIL:
+	case REG_ID_PIT:
+	case REG_ID_PCF:
+	case REG_ID_PFS:
+	case REG_ID_TRC:
+		reg_process_packet(reg | PACKET_WRITE_MASK, (reg_get_value(reg) & ~mask) | (value & mask), out_buffer, out_len);
+
+		out_buffer[0] = reg_get_value(reg);
+		*out_len = sizeof(uint8_t);
+		break;
+
+	// the irqs raise flags in between, the whole update must not be interrupted, and W1C/RC don't apply to it
+	case REG_ID_INT:
+	case REG_ID_GIN:
+	{
+		const uint32_t irq = save_and_disable_interrupts();
+
+		self.regs[reg] = (self.regs[reg] & ~mask) | (value & mask);
+		out_buffer[0] = self.regs[reg];
+		*out_len = sizeof(uint8_t);
+
+		restore_interrupts(irq);
+
+		power_activity();
+		break;
+	}
+
+	// reading the others has side effects or gives more than a byte, they can't be updated
+	default:
+		break;
+	}
+}
+
+uint8_t reg_reply_max_len(uint8_t in_reg)
+{
+	// writes never reply
+	if (in_reg & PACKET_WRITE_MASK)
+		return 0;
+
+	switch (in_reg) {
+	case REG_ID_FIF:
+	case REG_ID_TXL:
+	case REG_ID_HQS:
+	case REG_ID_UTS:
+	case REG_ID_GCN:
+	case REG_ID_GEV:
+	case REG_ID_PST:
+	case REG_ID_PWS:
+	case REG_ID_PCK:
+	case REG_ID_WQS:
+	case REG_ID_PFV:
+	case REG_ID_TRD:
+		return PACKET_OUT_MAX_LEN;
+
+	default:
+		return sizeof(uint8_t);
+	}
 }
 
 uint8_t reg_get_value(enum reg_id reg)
@@ -165,6 +658,18 @@ void reg_set_value(enum reg_id reg, uint8_t value)
 	self.regs[reg] = value;
 }
 
+uint8_t reg_take_value(enum reg_id reg)
+{
+	const uint32_t irq = save_and_disable_interrupts();
+
+	const uint8_t value = self.regs[reg];
+	self.regs[reg] = 0;
+
+	restore_interrupts(irq);
+
+	return value;
+}
+
 bool reg_is_bit_set(enum reg_id reg, uint8_t bit)
 {
 	return self.regs[reg] & bit;
@@ -176,7 +681,10 @@ void reg_set_bit(enum reg_id reg, uint8_t bit)
 	printf("%s: reg: 0x%02X, bit: %d\r\n", __func__, reg, bit);
 #endif
 
+	// the irqs and the host update bits of the same registers, the read-modify-write must not be interrupted
+	const uint32_t irq = save_and_disable_interrupts();
 	self.regs[reg] |= bit;
+	restore_interrupts(irq);
 }
 
 void reg_clear_bit(enum reg_id reg, uint8_t bit)
@@ -185,7 +693,9 @@ void reg_clear_bit(enum reg_id reg, uint8_t bit)
 	printf("%s: reg: 0x%02X, bit: %d\r\n", __func__, reg, bit);
 #endif
 
+	const uint32_t irq = save_and_disable_interrupts();
 	self.regs[reg] &= ~bit;
+	restore_interrupts(irq);
 }
 
 void reg_init(void)
@@ -195,11 +705,21 @@ void reg_init(void)
 	reg_set_value(REG_ID_DEB, 10);
 	reg_set_value(REG_ID_FRQ, 10);	// ms
 	reg_set_value(REG_ID_BK2, 255);
+	reg_set_value(REG_ID_DIR, 0xFF);	// all inputs
 	reg_set_value(REG_ID_PUD, 0xFF);
 	reg_set_value(REG_ID_HLD, 30);	// 10ms units
 	reg_set_value(REG_ID_ADR, 0x1F);
 	reg_set_value(REG_ID_IND, 1);	// ms
 	reg_set_value(REG_ID_CF2, CF2_TOUCH_INT | CF2_USB_KEYB_ON | CF2_USB_MOUSE_ON);
-
-	touchpad_add_touch_callback(&touch_callback);
+	reg_set_value(REG_ID_GCF, GCF_SWIPE_ON | GCF_SCROLL_ON | GCF_INERTIA_ON);
+	reg_set_value(REG_ID_SWT, 15);
+	reg_set_value(REG_ID_SWO, 5);
+	reg_set_value(REG_ID_PGL, 16);	// 1.0x
+	reg_set_value(REG_ID_PGH, 40);	// 2.5x
+	reg_set_value(REG_ID_PSL, 3);
+	reg_set_value(REG_ID_PSH, 20);
+	reg_set_value(REG_ID_PSM, 64);
+	reg_set_value(REG_ID_MPI, USB_MOUSE_POLL_MS);
+	reg_set_value(REG_ID_BCF, BCF_GAMMA_ON | BCF_KEY_WAKE | BCF_TOUCH_WAKE);
+	reg_set_value(REG_ID_TRC, TRC_ON);
 }
@@ -27,6 +27,49 @@ enum reg_id
 	REG_ID_CF2 = 0x14, // config 2
 	REG_ID_TOX = 0x15, // touch delta x since last read, at most (-128 to 127)
 	REG_ID_TOY = 0x16, // touch delta y since last read, at most (-128 to 127)
+	REG_ID_GES = 0x17, // last touch gesture since last read
+	REG_ID_GSX = 0x18, // gesture scroll pan steps since last read, at most (-128 to 127)
+	REG_ID_GSY = 0x19, // gesture scroll wheel steps since last read, at most (-128 to 127)
+	REG_ID_GCF = 0x1A, // gesture config
+	REG_ID_SWT = 0x1B, // swipe threshold, minimum motion along the swipe axis
+	REG_ID_SWO = 0x1C, // swipe tolerance, maximum motion across the swipe axis
+	REG_ID_TXL = 0x1D, // touch delta x since last read, low byte, reading it returns TXL to TST in one burst
+	REG_ID_TXH = 0x1E, // touch delta x since last read, high byte (-32768 to 32767)
+	REG_ID_TYL = 0x1F, // touch delta y since last read, low byte
+	REG_ID_TYH = 0x20, // touch delta y since last read, high byte (-32768 to 32767)
+	REG_ID_TST = 0x21, // touch delta saturation status
+	REG_ID_PGL = 0x22, // pointer gain at low speed (Q4, 16 = 1.0x)
+	REG_ID_PGH = 0x23, // pointer gain at high speed (Q4, 16 = 1.0x)
+	REG_ID_PSL = 0x24, // pointer speed up to which the low gain is used (counts per report)
+	REG_ID_PSH = 0x25, // pointer speed from which the high gain is used (counts per report)
+	REG_ID_PSM = 0x26, // pointer smoothing, weight of the previous motion (0 to 255)
+	REG_ID_HQS = 0x27, // usb hid report queue stats, queued/merged/dropped as 3x uint32
+	REG_ID_UTS = 0x28, // usb task stats, wakeups/timer wakeups/max latency/avg latency as 4x uint32
+	REG_ID_MPI = 0x29, // usb mouse polling interval (ms), writing it re-enumerates the usb device
+	REG_ID_CFS = 0x2A, // config store, write a CFS_* command, read the CFS_* status
+	REG_ID_GEC = 0x2B, // gpio edge capture enable
+	REG_ID_GEV = 0x2C, // gpio edge events, reading it returns a GEV_* header and up to GEV_MAX_EVENTS events
+	REG_ID_GPS = 0x2D, // gpio pin select, the pin GPM to GCN apply to
+	REG_ID_GPM = 0x2E, // gpio pin mode (GPM_*)
+	REG_ID_GPD = 0x2F, // gpio pin PWM duty (0 to 255)
+	REG_ID_GFL = 0x30, // gpio pin PWM frequency in Hz, low byte
+	REG_ID_GFH = 0x31, // gpio pin PWM frequency in Hz, high byte
+	REG_ID_GCN = 0x32, // gpio pin counter, edge count and edges per second as 2x uint32, writing it resets the count
+	REG_ID_GGF = 0x33, // gpio pin glitch filter, time in ms an input has to be stable before its edge is reported
+	REG_ID_BFT = 0x34, // backlight fade time (in 10ms units)
+	REG_ID_BCF = 0x35, // backlight config
+	REG_ID_BIT = 0x36, // backlight idle timeout (in seconds), 0 never dims
+	REG_ID_BIL = 0x37, // backlight idle level, the most the backlights are left on at after the idle timeout
+	REG_ID_PIT = 0x38, // power idle timeout (in seconds), 0 never sleeps
+	REG_ID_PCF = 0x39, // power config
+	REG_ID_PST = 0x3A, // power state, state and the time in ms spent active/idle/slow as 3x uint32, writing it resets PST, PWS and PCK
+	REG_ID_PWS = 0x3B, // power wake stats, wakeups/dormant wakeups/last latency/max latency as 4x uint32
+	REG_ID_PCK = 0x3C, // power clock stats, clk_sys in kHz/times raised/times lowered/times deferred as 4x uint32
+	REG_ID_WQS = 0x3D, // work queue stats, max latency/max run time/max irq time in us/dropped items as 4x uint32, writing it resets it
+	REG_ID_PFS = 0x3E, // performance counter select
+	REG_ID_PFV = 0x3F, // performance counter value, the one selected by PFS, writing it resets all of them
+	REG_ID_TRC = 0x40, // trace config
+	REG_ID_TRD = 0x41, // trace records, writing it empties the ring
 
 	REG_ID_LAST,
 };
@@ -43,8 +86,55 @@ enum reg_id
 #define CF2_TOUCH_INT		(1 << 0) // Should touch events generate interrupts
 #define CF2_USB_KEYB_ON		(1 << 1) // Should key events be sent over USB HID
 #define CF2_USB_MOUSE_ON	(1 << 2) // Should touch events be sent over USB HID
+#define CF2_TOUCH_ACCEL		(1 << 3) // Should touch events go through the acceleration and smoothing
+#define CF2_USB_STREAM_ON	(1 << 4) // Should key, touch, lock and gpio events be pushed on the USB vendor interface
+#define CF2_INT_W1C			(1 << 5) // Should writing INT/GIN only clear the bits written as 1
+#define CF2_INT_RC			(1 << 6) // Should reading INT/GIN clear them
 // TODO? CF2_STICKY_MODS // Pressing and releasing a mod affects next key pressed
 
+#define GCF_SWIPE_ON		(1 << 0) // Should motion while Alt is held be turned into swipes
+#define GCF_SCROLL_ON		(1 << 1) // Should motion while Sym is held be turned into scrolling
+#define GCF_INERTIA_ON		(1 << 2) // Should scrolling keep coasting after the finger stops
+#define GCF_TAP_ON			(1 << 3) // Should a short tap on the trackpad be reported as a click
+
+#define BCF_GAMMA_ON		(1 << 0) // Should the brightness be gamma corrected
+#define BCF_KEY_WAKE		(1 << 1) // Should key presses count as activity for the idle timeout
+#define BCF_TOUCH_WAKE		(1 << 2) // Should trackpad motion count as activity for the idle timeout
+
+#define PCF_SLOW_CLK_ON		(1 << 0) // Should the system clock be lowered while there's no activity
+#define PCF_DORMANT_ON		(1 << 1) // Should every clock be stopped while asleep without a USB host
+#define PCF_VREG_SCALE_ON	(1 << 2) // Should the core voltage be lowered along with the system clock
+
+#define CFS_SAVE			0x53 // Save the config registers to flash ('S')
+#define CFS_DEFAULTS		0x44 // Forget the saved config and reset with the defaults ('D')
+
+#define CFS_SAVED			(1 << 0) // There's a saved config, it was loaded at boot or saved since
+#define CFS_BUSY			(1 << 1) // A save is still pending
+#define CFS_FAILED			(1 << 2) // The last save couldn't be written
+
+#define GEV_COUNT_MASK		0x0F	 // Number of events in this reply
+#define GEV_MORE			(1 << 6) // More events are waiting
+#define GEV_OVERFLOW		(1 << 7) // Events were lost since the last read
+#define GEV_EVENT_LEN		5		 // pin index | level << 7, then the time in us as uint32
+#define GEV_MAX_EVENTS		((PACKET_OUT_MAX_LEN - 1) / GEV_EVENT_LEN)
+
+#define GPM_GPIO			0 // Plain GPIO, as set by REG_DIR
+#define GPM_PWM				1 // PWM output
+#define GPM_COUNTER			2 // Rising edge counter
+#define GPM_REFUSED			(1 << 7) // Read only, the last GPM, GPD, GFL or GFH write to the pin was refused
+
+#define PFS_UPTIME			0x00 // Uptime in ms as uint64
+#define PFS_COUNTER			0x01 // PFS_COUNTER + enum perf_counter, as uint32
+#define PFS_TIMER			0x10 // PFS_TIMER + enum perf_timer, count/min/avg/max in us as 4x uint32
+
+#define TRC_ON				(1 << 0) // Should the trace records be kept
+
+#define TRD_COUNT_MASK		0x0F	 // Number of records in this reply
+#define TRD_MORE			(1 << 6) // More records are waiting
+#define TRD_OVERFLOW		(1 << 7) // The oldest records were overwritten since the ring was last emptied
+#define TRD_RECORD_LEN		7		 // time in us as uint32, type, a, b
+#define TRD_MAX_RECORDS		((PACKET_OUT_MAX_LEN - 1) / TRD_RECORD_LEN)
+
 #define INT_OVERFLOW		(1 << 0)
 #define INT_CAPSLOCK		(1 << 1)
 #define INT_NUMLOCK			(1 << 2)
@@ -54,6 +144,11 @@ enum reg_id
 #define INT_TOUCH			(1 << 6)
 // Future me: If we need more INT_*, add a INT2 and use (1 << 7) here as indicator that the info is in INT2
 
+#define TST_TX_SAT			(1 << 0) // TXL/TXH hit its limit and motion was lost
+#define TST_TY_SAT			(1 << 1) // TYL/TYH hit its limit and motion was lost
+#define TST_TOX_SAT			(1 << 2) // TOX hit its limit and motion was lost
+#define TST_TOY_SAT			(1 << 3) // TOY hit its limit and motion was lost
+
 #define KEY_CAPSLOCK		(1 << 5) // Caps lock status
 #define KEY_NUMLOCK			(1 << 6) // Num lock status
 #define KEY_COUNT_MASK		0x1F
@@ -67,11 +162,15 @@ enum reg_id
 #define VER_VAL				((VERSION_MAJOR << 4) | (VERSION_MINOR << 0))
 
 #define PACKET_WRITE_MASK	(1 << 7)
+#define PACKET_OUT_MAX_LEN	16	 // largest reply reg_process_packet can produce
 
 void reg_process_packet(uint8_t in_reg, uint8_t in_data, uint8_t *out_buffer, uint8_t *out_len);
+void reg_update_packet(uint8_t reg, uint8_t mask, uint8_t value, uint8_t *out_buffer, uint8_t *out_len); // masked write, replies with the new value
+uint8_t reg_reply_max_len(uint8_t in_reg); // most bytes reg_process_packet can reply with for this packet, without running it
 
 uint8_t reg_get_value(enum reg_id reg);
 void reg_set_value(enum reg_id reg, uint8_t value);
+uint8_t reg_take_value(enum reg_id reg); // returns the value and clears the register in one go
 
 bool reg_is_bit_set(enum reg_id reg, uint8_t bit);
 void reg_set_bit(enum reg_id reg, uint8_t bit);
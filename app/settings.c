@@ -0,0 +1,309 @@
+#include "settings.h"
+
+#include "keyboard.h"
+#include "puppet_i2c.h"
+#include "reg.h"
+#include "work.h"
+
+#include <hardware/flash.h>
+#include <hardware/sync.h>
+#include <pico/stdlib.h>
+#include <RP2040.h> // TODO: When there's more than one RP chip, change this to be more generic
+#include <stdio.h>
+#include <string.h>
+
+#ifndef PICO_FLASH_SIZE_BYTES
+#define PICO_FLASH_SIZE_BYTES	(2 * 1024 * 1024)
+#endif
+
+// The settings live in the last sectors of the flash as a log, every save programs the next blank page and the
+// valid record with the highest sequence number wins. The sector after the active one is erased at boot, so saving
+// normally costs a single page program, ~1ms with every interrupt off. Only when the log went round since boot
+// does a save have to erase a sector, ~50ms, and that waits until nothing is going on.
+#define SETTINGS_SECTORS		2
+#define SETTINGS_OFFSET			(PICO_FLASH_SIZE_BYTES - (SETTINGS_SECTORS * FLASH_SECTOR_SIZE))
+#define PAGES_PER_SECTOR		(FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE)
+#define SETTINGS_PAGES			(SETTINGS_SECTORS * PAGES_PER_SECTOR)
+
+#define RECORD_MAGIC			0x50433249 // "I2CP"
+#define RECORD_MAX_ENTRIES		64
+
+#define ERASE_RETRY_MS			50 // how often a save waiting for a sector erase checks again
+
+enum write_result
+{
+	WRITE_DONE,
+	WRITE_FAILED,
+	WRITE_DEFERRED,	// a sector has to be erased first, and now is not a good time
+};
+
+struct record
+{
+	uint32_t magic;
+	uint32_t seq;
+	uint8_t count;
+	uint8_t reserved[3];
+	uint8_t entries[RECORD_MAX_ENTRIES][2]; // reg id, value
+	uint32_t crc;
+};
+
+// registers that are saved, a record only holds the ones it knows about so new ones keep their default.
+// the per-pin GPIO functions behind REG_GPS have one value per pin and aren't saved.
+static const enum reg_id saved_regs[] =
+{
+	REG_ID_CFG, REG_ID_DEB, REG_ID_FRQ, REG_ID_BKL, REG_ID_BK2,
+	REG_ID_DIR, REG_ID_PUE, REG_ID_PUD, REG_ID_GIC, REG_ID_HLD,
+	REG_ID_ADR, REG_ID_IND, REG_ID_CF2, REG_ID_GCF, REG_ID_SWT,
+	REG_ID_SWO, REG_ID_PGL, REG_ID_PGH, REG_ID_PSL, REG_ID_PSH,
+	REG_ID_PSM, REG_ID_MPI, REG_ID_GEC, REG_ID_BFT, REG_ID_BCF,
+	REG_ID_BIT, REG_ID_BIL, REG_ID_PIT, REG_ID_PCF,
+};
+
+static struct
+{
+	uint32_t seq;
+	uint32_t next_page;
+
+	bool saved;
+	bool busy;
+	bool failed;
+	bool clear;
+
+	// flash_range_program needs the data in RAM, and a whole page of it
+	uint8_t page[FLASH_PAGE_SIZE] __attribute__((aligned(4)));
+} self;
+
+static uint32_t crc32(const uint8_t *data, uint32_t len)
+{
+	uint32_t crc = 0xFFFFFFFF;
+
+	while (len--) {
+		crc ^= *data++;
+
+		for (uint8_t i = 0; i < 8; ++i)
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+	}
+
+	return ~crc;
+}
+
+static const struct record *page_record(uint32_t page)
+{
+	return (const struct record *)(XIP_BASE + SETTINGS_OFFSET + (page * FLASH_PAGE_SIZE));
+}
+
+static bool record_is_valid(const struct record *record)
+{
+	return (record->magic == RECORD_MAGIC) && (record->count <= RECORD_MAX_ENTRIES) &&
+		(record->crc == crc32((const uint8_t *)record, offsetof(struct record, crc)));
+}
+
+static bool page_is_blank(uint32_t page)
+{
+	const uint32_t *words = (const uint32_t *)page_record(page);
+
+	for (uint32_t i = 0; i < (FLASH_PAGE_SIZE / sizeof(uint32_t)); ++i) {
+		if (words[i] != 0xFFFFFFFF)
+			return false;
+	}
+
+	return true;
+}
+
+static bool sector_is_blank(uint32_t sector)
+{
+	for (uint32_t i = 0; i < PAGES_PER_SECTOR; ++i) {
+		if (!page_is_blank((sector * PAGES_PER_SECTOR) + i))
+			return false;
+	}
+
+	return true;
+}
+
+// an erase stalls everything, the controller and the keys would notice
+static bool can_stall(void)
+{
+	return !puppet_i2c_is_busy() && !keyboard_is_any_key_down();
+}
+
+// nothing may run from flash while it's being written, so no interrupts until it's done
+static void erase_sector(uint32_t sector)
+{
+	const uint32_t irq = save_and_disable_interrupts();
+	flash_range_erase(SETTINGS_OFFSET + (sector * FLASH_SECTOR_SIZE), FLASH_SECTOR_SIZE);
+	restore_interrupts(irq);
+}
+
+static void program_page(uint32_t page)
+{
+	const uint32_t irq = save_and_disable_interrupts();
+	flash_range_program(SETTINGS_OFFSET + (page * FLASH_PAGE_SIZE), self.page, FLASH_PAGE_SIZE);
+	restore_interrupts(irq);
+}
+
+static enum write_result write_record(void)
+{
+	for (uint32_t tries = 0; tries < SETTINGS_PAGES; ++tries) {
+		const uint32_t page = self.next_page;
+
+		// the log moves into a new sector, the latest record is in the previous one so this is safe to erase
+		if (((page % PAGES_PER_SECTOR) == 0) && !sector_is_blank(page / PAGES_PER_SECTOR)) {
+			if (!can_stall())
+				return WRITE_DEFERRED;
+
+			erase_sector(page / PAGES_PER_SECTOR);
+		}
+
+		self.next_page = (self.next_page + 1) % SETTINGS_PAGES;
+
+		// left over from a power cut in the middle of a save
+		if (!page_is_blank(page))
+			continue;
+
+		program_page(page);
+
+		if (memcmp(page_record(page), self.page, FLASH_PAGE_SIZE) == 0)
+			return WRITE_DONE;
+	}
+
+	return WRITE_FAILED;
+}
+
+static void save_work(uint32_t arg);
+
+static int64_t save_retry_task(alarm_id_t id, void *user_data)
+{
+	(void)id;
+	(void)user_data;
+
+	if (!work_post(WORK_PRIO_LOW, save_work, 0))
+		return ERASE_RETRY_MS * 1000;
+
+	return 0;
+}
+
+static void save_work(uint32_t arg)
+{
+	(void)arg;
+
+	struct record *record = (struct record *)self.page;
+
+	memset(self.page, 0xFF, sizeof(self.page));
+
+	record->magic = RECORD_MAGIC;
+	record->seq = self.seq + 1;
+	record->count = 0;
+	memset(record->reserved, 0, sizeof(record->reserved));
+
+	// a cleared config is just a record without entries
+	if (!self.clear) {
+		for (uint32_t i = 0; i < sizeof(saved_regs) / sizeof(saved_regs[0]); ++i) {
+			record->entries[record->count][0] = saved_regs[i];
+			record->entries[record->count][1] = reg_get_value(saved_regs[i]);
+			++record->count;
+		}
+	}
+
+	record->crc = crc32(self.page, offsetof(struct record, crc));
+
+	const enum write_result result = write_record();
+
+	// still busy, try again in a bit
+	if (result == WRITE_DEFERRED) {
+		add_alarm_in_ms(ERASE_RETRY_MS, save_retry_task, NULL, true);
+		return;
+	}
+
+	self.seq = record->seq;
+	self.failed = (result == WRITE_FAILED);
+	if (!self.failed)
+		self.saved = !self.clear;
+
+	self.busy = false;
+
+#ifndef NDEBUG
+	printf("%s: seq: %lu, entries: %d, failed: %d\r\n", __func__, (unsigned long)record->seq, record->count, self.failed);
+#endif
+
+	// come back up with the defaults in every module
+	if (self.clear && !self.failed)
+		NVIC_SystemReset();
+}
+
+static void request_save(bool clear)
+{
+	if (self.busy)
+		return;
+
+	// runs after the register access that asked for it has its reply
+	self.clear = clear;
+	self.busy = work_post(WORK_PRIO_LOW, save_work, 0);
+}
+
+void settings_save(void)
+{
+	request_save(false);
+}
+
+void settings_clear(void)
+{
+	request_save(true);
+}
+
+bool settings_saved(void)
+{
+	return self.saved;
+}
+
+bool settings_busy(void)
+{
+	return self.busy;
+}
+
+bool settings_failed(void)
+{
+	return self.failed;
+}
+
+void settings_init(void)
+{
+	const struct record *latest = NULL;
+	uint32_t latest_page = SETTINGS_PAGES - 1;
+
+	for (uint32_t page = 0; page < SETTINGS_PAGES; ++page) {
+		const struct record *record = page_record(page);
+
+		if (!record_is_valid(record))
+			continue;
+
+		// the sequence number may wrap, compare the distance instead of the values
+		if (!latest || ((int32_t)(record->seq - latest->seq) > 0)) {
+			latest = record;
+			latest_page = page;
+		}
+	}
+
+	if (latest) {
+		self.seq = latest->seq;
+
+		for (uint8_t i = 0; i < latest->count; ++i) {
+			for (uint32_t j = 0; j < sizeof(saved_regs) / sizeof(saved_regs[0]); ++j) {
+				if (latest->entries[i][0] == saved_regs[j])
+					reg_set_value(saved_regs[j], latest->entries[i][1]);
+			}
+		}
+
+		self.saved = (latest->count > 0);
+	}
+
+	self.next_page = (latest_page + 1) % SETTINGS_PAGES;
+
+	// nothing is scanning yet, so now is the time to have the next sector ready
+	const uint32_t spare = ((latest_page / PAGES_PER_SECTOR) + 1) % SETTINGS_SECTORS;
+	if (!sector_is_blank(spare))
+		erase_sector(spare);
+
+#ifndef NDEBUG
+	printf("%s: saved: %d, seq: %lu, next page: %lu\r\n", __func__, self.saved, (unsigned long)self.seq, (unsigned long)self.next_page);
+#endif
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdbool.h>
+
+// loads the last saved register values over the defaults, call after reg_init and before the other modules
+void settings_init(void);
+
+// saving and clearing happen in the background, the flash isn't touched from the caller's context
+void settings_save(void);
+void settings_clear(void); // forgets the saved config and resets, so everything comes back with the defaults
+
+bool settings_saved(void);	// there's a saved config, loaded at boot or saved since
+bool settings_busy(void);	// a save/clear is still pending
+bool settings_failed(void);	// the last save/clear couldn't be written
@@ -1,6 +1,10 @@
 #include "touchpad.h"
 
-#include "keyboard.h"
+#include "events.h"
+#include "gesture.h"
+#include "perf.h"
+#include "pointer.h"
+#include "work.h"
 
 #include <hardware/i2c.h>
 #include <pico/binary_info.h>
@@ -8,6 +12,8 @@
 #include <stdio.h>
 
 #define DEV_ADDR			0x3B
+#define I2C_BAUDRATE		(100 * 1000)
+#define MOTION_RETRY_US		500 // how often the motion read is posted again when the work queue had no room
 
 #define REG_PID				0x00
 #define REG_REV				0x01
@@ -29,17 +35,12 @@
 #define BIT_OBSERV_REST2	(2 << 6)
 #define BIT_OBSERV_REST3	(3 << 6)
 
-#define SWIPE_COOLDOWN_TIME_MS	100 // time to wait before generating a new swipe event
-#define SWIPE_RELEASE_DELAY_MS	10  // time to wait before sending key release event
-#define MOTION_IS_SWIPE(i, j)	(((i >= 15) || (i <= -15)) && ((j >= -5) && (j <= 5)))
-
 static i2c_inst_t *i2c_instances[2] = { i2c0, i2c1 };
 
 static struct
 {
-	struct touch_callback *callbacks;
-	uint32_t last_swipe_time;
 	i2c_inst_t *i2c;
+	bool motion_posted;	// motion_work is posted, or an alarm posts it once the queue has room
 } self;
 
 static uint8_t read_register8(uint8_t reg)
@@ -58,13 +59,41 @@ static uint8_t read_register8(uint8_t reg)
 //	i2c_write_blocking(self.i2c, DEV_ADDR, buffer, sizeof(buffer), false);
 //}
 
-int64_t release_key(alarm_id_t id, void *user_data)
+static void motion_work(uint32_t arg)
 {
-	(void)id;
+	(void)arg;
+
+	self.motion_posted = false;
+
+	const uint32_t start_time = perf_start();
+
+	const uint8_t motion = read_register8(REG_MOTION);
+	if (motion & BIT_MOTION_MOT) {
+		int8_t x = read_register8(REG_DELTA_X);
+		int8_t y = read_register8(REG_DELTA_Y);
+
+		x = ((x < 127) ? x : (x - 256)) * -1;
+		y = ((y < 127) ? y : (y - 256));
 
-	const int data = (int)user_data;
+		if (gesture_process_motion(x, y)) {
+			perf_time(PERF_TIMER_TOUCH_READ, start_time);
+			return;
+		}
+
+		if (pointer_process(&x, &y))
+			events_touch(x, y);
+	}
 
-	keyboard_inject_event((char)data, KEY_STATE_RELEASED);
+	perf_time(PERF_TIMER_TOUCH_READ, start_time);
+}
+
+static int64_t motion_retry_task(alarm_id_t id, void *user_data)
+{
+	(void)id;
+	(void)user_data;
+
+	if (!work_post(WORK_PRIO_NORMAL, motion_work, 0))
+		return MOTION_RETRY_US;
 
 	return 0;
 }
@@ -77,60 +106,26 @@ void touchpad_gpio_irq(uint gpio, uint32_t events)
 	if (!(events & GPIO_IRQ_EDGE_FALL))
 		return;
 
-	const uint8_t motion = read_register8(REG_MOTION);
-	if (motion & BIT_MOTION_MOT) {
-		int8_t x = read_register8(REG_DELTA_X);
-		int8_t y = read_register8(REG_DELTA_Y);
+	const uint32_t start_time = perf_start();
 
-		x = ((x < 127) ? x : (x - 256)) * -1;
-		y = ((y < 127) ? y : (y - 256));
+	// reading the motion takes three blocking I2C transfers, the main loop does that.
+	// the sensor keeps the pin low until it's read, so a lost post would stop the trackpad for good.
+	if (!self.motion_posted) {
+		self.motion_posted = true;
 
-		if (keyboard_is_mod_on(KEY_MOD_ID_ALT)) {
-			if (to_ms_since_boot(get_absolute_time()) - self.last_swipe_time > SWIPE_COOLDOWN_TIME_MS) {
-				char key = '\0';
-				if (MOTION_IS_SWIPE(y, x)) {
-					key = (y < 0) ? KEY_JOY_UP : KEY_JOY_DOWN;
-				} else if (MOTION_IS_SWIPE(x, y)) {
-					key = (x < 0) ? KEY_JOY_LEFT : KEY_JOY_RIGHT;
-				}
-
-				if (key != '\0') {
-					keyboard_inject_event(key, KEY_STATE_PRESSED);
-
-					// we need to allow the usb a bit of time to send the press, so schedule the release after a bit
-					add_alarm_in_ms(SWIPE_RELEASE_DELAY_MS, release_key, (void*)(int)key, true);
-
-					self.last_swipe_time = to_ms_since_boot(get_absolute_time());
-				}
-			}
-		} else {
-			if (self.callbacks) {
-				struct touch_callback *cb = self.callbacks;
-
-				while (cb) {
-					cb->func(x, y);
-
-					cb = cb->next;
-				}
-			}
-		}
+		if (!work_post(WORK_PRIO_NORMAL, motion_work, 0))
+			add_alarm_in_us(MOTION_RETRY_US, motion_retry_task, NULL, true);
 	}
+
+	perf_time(PERF_TIMER_TOUCH_IRQ, start_time);
 }
 
-void touchpad_add_touch_callback(struct touch_callback *callback)
+// the SCL timing is counted in system clocks
+void touchpad_clock_cb(uint32_t sys_hz)
 {
-	// first callback
-	if (!self.callbacks) {
-		self.callbacks = callback;
-		return;
-	}
-
-	// find last and insert after
-	struct touch_callback *cb = self.callbacks;
-	while (cb->next)
-		cb = cb->next;
+	(void)sys_hz;
 
-	cb->next = callback;
+	i2c_set_baudrate(self.i2c, I2C_BAUDRATE);
 }
 
 void touchpad_init(void)
@@ -138,7 +133,7 @@ void touchpad_init(void)
 	// determine the instance based on SCL pin, hope you didn't screw up the SDA pin!
 	self.i2c = i2c_instances[(PIN_SCL / 2) % 2];
 
-	i2c_init(self.i2c, 100 * 1000);
+	i2c_init(self.i2c, I2C_BAUDRATE);
 
 	gpio_set_function(PIN_SDA, GPIO_FUNC_I2C);
 	gpio_pull_up(PIN_SDA);
@@ -0,0 +1,84 @@
+#include "trace.h"
+
+#if TRACE_RING
+
+#include "reg.h"
+
+#include <hardware/sync.h>
+#include <pico/stdlib.h>
+
+#define TRACE_SIZE		512 // records, 8 bytes each
+
+static struct
+{
+	struct trace_record records[TRACE_SIZE];
+	uint16_t write_idx;
+	uint16_t count;
+	bool overflow;
+} self;
+
+void trace(enum trace_type type, uint8_t a, uint8_t b)
+{
+	if (!reg_is_bit_set(REG_ID_TRC, TRC_ON))
+		return;
+
+	// the time is taken with the irqs off as well, so the ring stays in time order
+	const uint32_t irq = save_and_disable_interrupts();
+
+	struct trace_record *record = &self.records[self.write_idx];
+	record->time = time_us_32();
+	record->type = type;
+	record->a = a;
+	record->b = b;
+
+	self.write_idx = (self.write_idx + 1) % TRACE_SIZE;
+
+	if (self.count < TRACE_SIZE)
+		++self.count;
+	else
+		self.overflow = true;
+
+	restore_interrupts(irq);
+}
+
+bool trace_pop(struct trace_record *record)
+{
+	bool found = false;
+
+	const uint32_t irq = save_and_disable_interrupts();
+
+	if (self.count) {
+		*record = self.records[(self.write_idx + TRACE_SIZE - self.count) % TRACE_SIZE];
+		--self.count;
+		found = true;
+	}
+
+	restore_interrupts(irq);
+
+	return found;
+}
+
+uint16_t trace_count(void)
+{
+	return self.count;
+}
+
+bool trace_take_overflow(void)
+{
+	const bool overflow = self.overflow;
+	self.overflow = false;
+
+	return overflow;
+}
+
+void trace_clear(void)
+{
+	const uint32_t irq = save_and_disable_interrupts();
+
+	self.count = 0;
+	self.overflow = false;
+
+	restore_interrupts(irq);
+}
+
+#endif
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Flight recorder for the input path, a RAM ring of timestamped records that keeps the newest ones. Read through
+// REG_TRD, etc/puppet_trace.py turns a dump into a timeline. Built with TRACE_RING=0 every call below is an empty
+// inline and REG_TRD doesn't reply.
+
+enum trace_type
+{
+	TRACE_SCAN_START = 1,
+	TRACE_SCAN_END,
+	TRACE_KEY,			// a: matrix key, b: enum key_state it went to
+	TRACE_FIFO_PUSH,	// a: key, b: enum key_state
+	TRACE_FIFO_POP,		// a: key, b: enum key_state, 0 0 if REG_FIF was empty
+	TRACE_I2C,			// a: register with PACKET_WRITE_MASK on writes, b: value written
+	TRACE_INT_PULSE,	// a: REG_INT
+	TRACE_USB_KEYB,		// a: modifiers, b: first keycode
+	TRACE_USB_MOUSE,	// a: buttons
+};
+
+struct trace_record
+{
+	uint32_t time;		// us, wraps around
+	uint8_t type;
+	uint8_t a;
+	uint8_t b;
+};
+
+#if TRACE_RING
+
+// safe to call from irqs, does nothing while TRC_ON is cleared
+void trace(enum trace_type type, uint8_t a, uint8_t b);
+
+// oldest first, false once the ring is empty
+bool trace_pop(struct trace_record *record);
+uint16_t trace_count(void);
+bool trace_take_overflow(void);
+void trace_clear(void);
+
+#else
+
+static inline void trace(enum trace_type type, uint8_t a, uint8_t b) { (void)type; (void)a; (void)b; }
+
+#endif
@@ -27,7 +27,7 @@ enum
 #define CFG_TUD_MIDI				0
 #define CFG_TUD_VENDOR				1
 
-#define CFG_TUD_HID_EP_BUFSIZE		8
+#define CFG_TUD_HID_EP_BUFSIZE		16 // the mouse report is 9 bytes
 
 #define CFG_TUD_CDC_RX_BUFSIZE		256
 #define CFG_TUD_CDC_TX_BUFSIZE		256
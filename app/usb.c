@@ -1,168 +1,673 @@
 #include "usb.h"
 
 #include "backlight.h"
+#include "debug.h"
+#include "events.h"
+#include "gesture.h"
+#include "gpioexp.h"
 #include "keyboard.h"
-#include "touchpad.h"
+#include "perf.h"
+#include "power.h"
 #include "reg.h"
+#include "settings.h"
+#include "trace.h"
+#include "work.h"
 
 #include <hardware/irq.h>
-#include <pico/mutex.h>
+#include <hardware/sync.h>
 #include <tusb.h>
 
-#define USB_LOW_PRIORITY_IRQ	31
-#define USB_TASK_INTERVAL_US	1000
+#define USB_TASK_RETRY_US		1000 // how often tud_task is posted again when the work queue had no room
+#define TAP_RELEASE_DELAY_MS	10 // time to wait before sending the button release of a tap
+#define REENUM_DELAY_MS			10 // time to wait before disconnecting, lets the reply of the triggering write go out
+#define REENUM_OFF_MS			50 // time to stay disconnected so the host notices
+
+#define VENDOR_PACKET_SIZE		64
+#define VENDOR_BATCH_MARKER		0x00 // there's no register 0, so a packet starting with it is a batch
+#define VENDOR_BATCH_UPDATE		0x00 // batch op: masked write (reg, mask, value), replies with the new value
+#define VENDOR_BATCH_HEADER_LEN	3    // marker, sequence number, op count
+
+#define VENDOR_STREAM_ITF		0    // vendor instance the events are pushed on
+#define VENDOR_EVENT_MARKER		0xE0 // first byte of an event packet
+#define VENDOR_EVENT_HEADER_LEN	3    // marker, flags, event count
+#define VENDOR_EVENT_LEN		3    // type, 2 bytes of data
+#define VENDOR_EVENT_LOST		(1 << 0) // flag: events were lost before this packet
+#define VENDOR_REPLY_MARKER		0xE1 // first byte of a single register reply while streaming
+#define VENDOR_REPLY_HEADER_LEN	2    // marker, reply length
+
+#define STREAM_QUEUE_SIZE		64
+
+#define KEYB_QUEUE_SIZE			16
+#define MOUSE_QUEUE_SIZE		8
+
+// mouse feature report, the resolution multipliers (0 = 1x, 1 = USB_MOUSE_WHEEL_MULTIPLIER) the host selected
+#define MOUSE_FEATURE_WHEEL_HIRES	(1 << 0)
+#define MOUSE_FEATURE_PAN_HIRES		(1 << 2)
+
+struct keyb_report
+{
+	uint8_t modifier;
+	uint8_t keycode[6];
+};
+
+// also the input report layout of hid_mouse_descriptor
+struct mouse_report
+{
+	uint8_t buttons;
+	int16_t x;
+	int16_t y;
+	int16_t wheel;
+	int16_t pan;
+} __attribute__((packed));
 
 static struct
 {
-	mutex_t mutex;
 	bool mouse_moved;
 	uint8_t mouse_btn;
 
-	uint8_t write_buffer[2];
+	struct
+	{
+		struct keyb_report items[KEYB_QUEUE_SIZE];
+		uint8_t count;
+		uint8_t read_idx;
+	} keyb_queue;
+
+	struct
+	{
+		struct mouse_report items[MOUSE_QUEUE_SIZE];
+		uint8_t count;
+		uint8_t read_idx;
+	} mouse_queue;
+
+	struct usb_report_stats stats;
+
+	uint8_t mouse_feature;
+	int16_t wheel_rem;
+	int16_t pan_rem;
+
+	struct
+	{
+		uint8_t items[STREAM_QUEUE_SIZE][VENDOR_EVENT_LEN];
+		uint8_t count;
+		uint8_t read_idx;
+		bool lost;
+	} stream;
+
+	struct usb_task_stats task_stats;
+	uint32_t task_request_time;
+	bool task_requested;	// task_work is posted, or an alarm posts it once the queue has room
+	bool reenumerating;
+	bool reenum_disconnected;
+
+	uint8_t write_buffer[PACKET_OUT_MAX_LEN];
 	uint8_t write_len;
 } self;
 
+#define KEYCODE_TABLE_SIZE		128
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+
+// { shift, HID keycode } for every key code, the firmware specific codes override the ASCII ones
+static const uint8_t keycode_table[KEYCODE_TABLE_SIZE][2] =
+{
+	HID_ASCII_TO_KEYCODE,
+
+	['\n']				= { 0, HID_KEY_ENTER }, // Fixup: Enter instead of Return
+
+	[KEY_JOY_UP]		= { 0, HID_KEY_ARROW_UP },
+	[KEY_JOY_DOWN]		= { 0, HID_KEY_ARROW_DOWN },
+	[KEY_JOY_LEFT]		= { 0, HID_KEY_ARROW_LEFT },
+	[KEY_JOY_RIGHT]		= { 0, HID_KEY_ARROW_RIGHT },
+	[KEY_JOY_CENTER]	= { 0, HID_KEY_NONE }, // Sent as a mouse button
+
+	[KEY_BTN_LEFT1]		= { 0, HID_KEY_NONE },
+	[KEY_BTN_RIGHT1]	= { 0, HID_KEY_NONE },
+	[KEY_BTN_LEFT2]		= { 0, HID_KEY_NONE },
+	[KEY_BTN_RIGHT2]	= { 0, HID_KEY_NONE },
+
+	// Don't send mods over USB
+	[KEY_MOD_ALT]		= { 0, HID_KEY_NONE },
+	[KEY_MOD_SHL]		= { 0, HID_KEY_NONE },
+	[KEY_MOD_SHR]		= { 0, HID_KEY_NONE },
+	[KEY_MOD_SYM]		= { 0, HID_KEY_NONE },
+};
+
+#pragma GCC diagnostic pop
+
 // TODO: What about Ctrl?
 // TODO: What should L1, L2, R1, R2 do
 // TODO: Should touch send arrow keys as an option?
 
-static void low_priority_worker_irq(void)
+static void task_work(uint32_t arg);
+
+static int64_t retry_task(alarm_id_t id, void *user_data)
 {
-	if (mutex_try_enter(&self.mutex, NULL)) {
-		tud_task();
+	(void)id;
+	(void)user_data;
+
+	if (!work_post(WORK_PRIO_LOW, task_work, 0))
+		return USB_TASK_RETRY_US;
 
-		mutex_exit(&self.mutex);
+	++self.task_stats.timer_wakeups;
+
+	return 0;
+}
+
+// called from the usb irq and the main loop
+static void request_task(void)
+{
+	const uint32_t irq = save_and_disable_interrupts();
+
+	if (!self.task_requested) {
+		self.task_request_time = time_us_32();
+
+		// with the work queue full the run comes from an alarm once there's room, nothing polls for it
+		self.task_requested = work_post(WORK_PRIO_LOW, task_work, 0) ||
+							  (add_alarm_in_us(USB_TASK_RETRY_US, retry_task, NULL, true) > 0);
 	}
+
+	restore_interrupts(irq);
 }
 
-static int64_t timer_task(alarm_id_t id, void *user_data)
+void usb_request_task(void)
 {
-	(void)id;
-	(void)user_data;
+	request_task();
+}
+
+static void send_next_report(uint8_t itf)
+{
+	if (!tud_hid_n_ready(itf))
+		return;
+
+	if ((itf == USB_ITF_KEYBOARD) && self.keyb_queue.count) {
+		const struct keyb_report *report = &self.keyb_queue.items[self.keyb_queue.read_idx];
+
+		if (!tud_hid_n_keyboard_report(itf, 0, report->modifier, report->keycode))
+			return;
 
-	irq_set_pending(USB_LOW_PRIORITY_IRQ);
+		perf_count(PERF_USB_REPORTS_SENT);
+		trace(TRACE_USB_KEYB, report->modifier, report->keycode[0]);
 
-	return USB_TASK_INTERVAL_US;
+		self.keyb_queue.read_idx = (self.keyb_queue.read_idx + 1) % KEYB_QUEUE_SIZE;
+		--self.keyb_queue.count;
+	} else if ((itf == USB_ITF_MOUSE) && self.mouse_queue.count) {
+		const struct mouse_report *report = &self.mouse_queue.items[self.mouse_queue.read_idx];
+
+		if (!tud_hid_n_report(itf, 0, report, sizeof(*report)))
+			return;
+
+		perf_count(PERF_USB_REPORTS_SENT);
+		trace(TRACE_USB_MOUSE, report->buttons, 0);
+
+		self.mouse_queue.read_idx = (self.mouse_queue.read_idx + 1) % MOUSE_QUEUE_SIZE;
+		--self.mouse_queue.count;
+	}
 }
 
-static void key_cb(char key, enum key_state state)
+static void flush_report_queues(void)
 {
-	// Don't send mods over USB
-	if ((key == KEY_MOD_SHL) ||
-		(key == KEY_MOD_SHR) ||
-		(key == KEY_MOD_ALT) ||
-		(key == KEY_MOD_SYM))
+	self.keyb_queue.count = 0;
+	self.mouse_queue.count = 0;
+}
+
+static void queue_keyboard_report(uint8_t modifier, const uint8_t keycode[6])
+{
+	if (!tud_ready())
 		return;
 
-	if (tud_hid_n_ready(USB_ITF_KEYBOARD) && reg_is_bit_set(REG_ID_CF2, CF2_USB_KEYB_ON)) {
-		uint8_t conv_table[128][2]		= { HID_ASCII_TO_KEYCODE };
-		conv_table['\n'][1]				= HID_KEY_ENTER; // Fixup: Enter instead of Return
-		conv_table[KEY_JOY_UP][1]		= HID_KEY_ARROW_UP;
-		conv_table[KEY_JOY_DOWN][1]		= HID_KEY_ARROW_DOWN;
-		conv_table[KEY_JOY_LEFT][1]		= HID_KEY_ARROW_LEFT;
-		conv_table[KEY_JOY_RIGHT][1]	= HID_KEY_ARROW_RIGHT;
+	struct keyb_report *report;
+
+	if (self.keyb_queue.count < KEYB_QUEUE_SIZE) {
+		report = &self.keyb_queue.items[(self.keyb_queue.read_idx + self.keyb_queue.count) % KEYB_QUEUE_SIZE];
+		++self.keyb_queue.count;
+		++self.stats.queued;
+	} else {
+		// every report carries the whole key state, so replacing the newest one only loses the in-between state
+		report = &self.keyb_queue.items[(self.keyb_queue.read_idx + self.keyb_queue.count - 1) % KEYB_QUEUE_SIZE];
+		++self.stats.dropped;
+		perf_count(PERF_USB_REPORTS_DROPPED);
+	}
+
+	report->modifier = modifier;
+	memcpy(report->keycode, keycode, sizeof(report->keycode));
+
+	request_task();
+}
 
+static void queue_mouse_report(uint8_t buttons, int16_t x, int16_t y, int16_t wheel, int16_t pan)
+{
+	if (!tud_ready())
+		return;
+
+	struct mouse_report *report = NULL;
+
+	if (self.mouse_queue.count)
+		report = &self.mouse_queue.items[(self.mouse_queue.read_idx + self.mouse_queue.count - 1) % MOUSE_QUEUE_SIZE];
+
+	if (report && (report->buttons == buttons)) {
+		++self.stats.merged;
+	} else if (self.mouse_queue.count < MOUSE_QUEUE_SIZE) {
+		report = &self.mouse_queue.items[(self.mouse_queue.read_idx + self.mouse_queue.count) % MOUSE_QUEUE_SIZE];
+		memset(report, 0, sizeof(*report));
+		report->buttons = buttons;
+
+		++self.mouse_queue.count;
+		++self.stats.queued;
+	} else {
+		// no room for the button change, fold it into the newest report
+		report->buttons = buttons;
+		++self.stats.dropped;
+		perf_count(PERF_USB_REPORTS_DROPPED);
+	}
+
+	// -32768 is outside the logical range of the descriptor
+	report->x = MAX(-INT16_MAX, MIN(report->x + x, INT16_MAX));
+	report->y = MAX(-INT16_MAX, MIN(report->y + y, INT16_MAX));
+	report->wheel = MAX(-INT16_MAX, MIN(report->wheel + wheel, INT16_MAX));
+	report->pan = MAX(-INT16_MAX, MIN(report->pan + pan, INT16_MAX));
+
+	request_task();
+}
+
+static void stream_push(enum usb_event type, uint8_t data0, uint8_t data1)
+{
+	if (!reg_is_bit_set(REG_ID_CF2, CF2_USB_STREAM_ON) || !tud_ready())
+		return;
+
+	if (self.stream.count >= STREAM_QUEUE_SIZE) {
+		self.stream.lost = true;
+		return;
+	}
+
+	uint8_t *event = self.stream.items[(self.stream.read_idx + self.stream.count) % STREAM_QUEUE_SIZE];
+	event[0] = type;
+	event[1] = data0;
+	event[2] = data1;
+	++self.stream.count;
+
+	request_task();
+}
+
+static void stream_flush(void)
+{
+	if (!reg_is_bit_set(REG_ID_CF2, CF2_USB_STREAM_ON)) {
+		self.stream.count = 0;
+		return;
+	}
+
+	// only whole packets go into the fifo, as many events per packet as there's room for
+	while (self.stream.count) {
+		const uint32_t space = MIN(tud_vendor_n_write_available(VENDOR_STREAM_ITF), VENDOR_PACKET_SIZE);
+		if (space < VENDOR_EVENT_HEADER_LEN + VENDOR_EVENT_LEN)
+			return;
+
+		uint8_t packet[VENDOR_PACKET_SIZE];
+		const uint8_t count = MIN(self.stream.count, (space - VENDOR_EVENT_HEADER_LEN) / VENDOR_EVENT_LEN);
+
+		packet[0] = VENDOR_EVENT_MARKER;
+		packet[1] = self.stream.lost ? VENDOR_EVENT_LOST : 0;
+		packet[2] = count;
+
+		for (uint8_t i = 0; i < count; ++i) {
+			memcpy(&packet[VENDOR_EVENT_HEADER_LEN + i * VENDOR_EVENT_LEN], self.stream.items[self.stream.read_idx], VENDOR_EVENT_LEN);
+			self.stream.read_idx = (self.stream.read_idx + 1) % STREAM_QUEUE_SIZE;
+		}
+
+		self.stream.count -= count;
+		self.stream.lost = false;
+
+		tud_vendor_n_write(VENDOR_STREAM_ITF, packet, VENDOR_EVENT_HEADER_LEN + count * VENDOR_EVENT_LEN);
+	}
+}
+
+// tud_task only ever runs from the main loop, so it can't interrupt itself
+static void task_work(uint32_t arg)
+{
+	(void)arg;
+
+	++self.task_stats.wakeups;
+
+	const uint32_t latency = time_us_32() - self.task_request_time;
+
+	self.task_stats.latency_max_us = MAX(self.task_stats.latency_max_us, latency);
+	self.task_stats.latency_avg_us = (self.task_stats.latency_avg_us * 7 + latency) / 8;
+
+	// anything queued from here on needs another run
+	self.task_requested = false;
+
+	tud_task();
+
+	// kick off the queues, after that they are drained from tud_hid_report_complete_cb
+	send_next_report(USB_ITF_KEYBOARD);
+	send_next_report(USB_ITF_MOUSE);
+
+	stream_flush();
+
+#ifndef NDEBUG
+	debug_flush();
+#endif
+}
+
+// runs after the TinyUSB handler has queued up its events
+static void usb_irq(void)
+{
+	request_task();
+}
+
+void usb_key_cb(char key, enum key_state state)
+{
+	const uint8_t code = (uint8_t)key;
+
+	stream_push(USB_EVENT_KEY, code, state);
+
+	if ((state != KEY_STATE_HOLD) && (code < KEYCODE_TABLE_SIZE) && (keycode_table[code][1] != HID_KEY_NONE) &&
+		reg_is_bit_set(REG_ID_CF2, CF2_USB_KEYB_ON)) {
 		uint8_t keycode[6] = { 0 };
 		uint8_t modifier   = 0;
 
 		if (state == KEY_STATE_PRESSED) {
-			if (conv_table[(int)key][0])
+			if (keycode_table[code][0])
 				modifier = KEYBOARD_MODIFIER_LEFTSHIFT;
 
-			keycode[0] = conv_table[(int)key][1];
+			keycode[0] = keycode_table[code][1];
 		}
 
-		if (state != KEY_STATE_HOLD)
-			tud_hid_n_keyboard_report(USB_ITF_KEYBOARD, 0, modifier, keycode);
+		queue_keyboard_report(modifier, keycode);
 	}
 
-	if (tud_hid_n_ready(USB_ITF_MOUSE) && reg_is_bit_set(REG_ID_CF2, CF2_USB_MOUSE_ON)) {
+	if (reg_is_bit_set(REG_ID_CF2, CF2_USB_MOUSE_ON)) {
 		if (key == KEY_JOY_CENTER) {
 			if (state == KEY_STATE_PRESSED) {
 				self.mouse_btn = MOUSE_BUTTON_LEFT;
 				self.mouse_moved = false;
-				tud_hid_n_mouse_report(USB_ITF_MOUSE, 0, MOUSE_BUTTON_LEFT, 0, 0, 0, 0);
+				queue_mouse_report(MOUSE_BUTTON_LEFT, 0, 0, 0, 0);
 			} else if ((state == KEY_STATE_HOLD) && !self.mouse_moved) {
 				self.mouse_btn = MOUSE_BUTTON_RIGHT;
-				tud_hid_n_mouse_report(USB_ITF_MOUSE, 0, MOUSE_BUTTON_RIGHT, 0, 0, 0, 0);
+				queue_mouse_report(MOUSE_BUTTON_RIGHT, 0, 0, 0, 0);
 			} else if (state == KEY_STATE_RELEASED) {
 				self.mouse_btn = 0x00;
-				tud_hid_n_mouse_report(USB_ITF_MOUSE, 0, 0x00, 0, 0, 0, 0);
+				queue_mouse_report(0x00, 0, 0, 0, 0);
 			}
 		}
 	}
 }
-static struct key_callback key_callback = { .func = key_cb };
 
-static void touch_cb(int8_t x, int8_t y)
+void usb_key_lock_cb(bool caps_changed, bool num_changed)
+{
+	const uint8_t changed = (caps_changed ? USB_EVENT_LOCK_CAPS : 0) | (num_changed ? USB_EVENT_LOCK_NUM : 0);
+	const uint8_t state = (keyboard_get_capslock() ? USB_EVENT_LOCK_CAPS : 0) | (keyboard_get_numlock() ? USB_EVENT_LOCK_NUM : 0);
+
+	stream_push(USB_EVENT_LOCK, changed, state);
+}
+
+void usb_touch_cb(int8_t x, int8_t y)
 {
-	if (!tud_hid_n_ready(USB_ITF_MOUSE) || !reg_is_bit_set(REG_ID_CF2, CF2_USB_MOUSE_ON))
+	stream_push(USB_EVENT_TOUCH, x, y);
+
+	if (!reg_is_bit_set(REG_ID_CF2, CF2_USB_MOUSE_ON))
 		return;
 
 	self.mouse_moved = true;
 
-	tud_hid_n_mouse_report(USB_ITF_MOUSE, 0, self.mouse_btn, x, y, 0, 0);
+	queue_mouse_report(self.mouse_btn, x, y, 0, 0);
+}
+
+static void release_tap_work(uint32_t arg)
+{
+	(void)arg;
+
+	self.mouse_btn = 0x00;
+	queue_mouse_report(self.mouse_btn, 0, 0, 0, 0);
+}
+
+static int64_t release_tap(alarm_id_t id, void *user_data)
+{
+	(void)id;
+	(void)user_data;
+
+	// the release goes through the same report queue as the press, in the main loop
+	if (!work_post(WORK_PRIO_NORMAL, release_tap_work, 0))
+		return TAP_RELEASE_DELAY_MS * 1000;
+
+	return 0;
+}
+
+// gesture scroll units to report units, whole steps unless the host enabled the resolution multiplier
+static int16_t scroll_units(int8_t value, bool hires, int16_t *rem)
+{
+	if (hires)
+		return (value * USB_MOUSE_WHEEL_MULTIPLIER) / GESTURE_SCROLL_RES;
+
+	*rem += value;
+
+	const int16_t steps = *rem / GESTURE_SCROLL_RES;
+	*rem -= steps * GESTURE_SCROLL_RES;
+
+	return steps;
+}
+
+void usb_gesture_cb(enum gesture gesture, int8_t x, int8_t y)
+{
+	if (!reg_is_bit_set(REG_ID_CF2, CF2_USB_MOUSE_ON))
+		return;
+
+	switch (gesture) {
+	case GESTURE_SCROLL:
+	{
+		const int16_t wheel = scroll_units(y, self.mouse_feature & MOUSE_FEATURE_WHEEL_HIRES, &self.wheel_rem);
+		const int16_t pan = scroll_units(x, self.mouse_feature & MOUSE_FEATURE_PAN_HIRES, &self.pan_rem);
+
+		if (wheel || pan)
+			queue_mouse_report(self.mouse_btn, 0, 0, wheel, pan);
+		break;
+	}
+
+	case GESTURE_TAP:
+		self.mouse_btn = MOUSE_BUTTON_LEFT;
+		queue_mouse_report(self.mouse_btn, 0, 0, 0, 0);
+
+		// a separate release makes the host see a click instead of a press merged with the release
+		add_alarm_in_ms(TAP_RELEASE_DELAY_MS, release_tap, NULL, true);
+		break;
+
+	default:
+		break;
+	}
+}
+
+void usb_gpioexp_cb(uint8_t gpio, uint8_t gpio_idx, bool level)
+{
+	(void)gpio;
+
+	// the pin may have moved again since the edge, the level it had then is the one that belongs to it
+	stream_push(USB_EVENT_GPIO, gpio_idx, level);
 }
-static struct touch_callback touch_callback = { .func = touch_cb };
 
 uint16_t tud_hid_get_report_cb(uint8_t itf, uint8_t report_id, hid_report_type_t report_type, uint8_t *buffer, uint16_t reqlen)
 {
-	// TODO not Implemented
-	(void)itf;
 	(void)report_id;
-	(void)report_type;
-	(void)buffer;
-	(void)reqlen;
 
+	if ((itf == USB_ITF_MOUSE) && (report_type == HID_REPORT_TYPE_FEATURE) && (reqlen >= sizeof(self.mouse_feature))) {
+		buffer[0] = self.mouse_feature;
+		return sizeof(self.mouse_feature);
+	}
+
+	// TODO: keyboard reports not Implemented
 	return 0;
 }
 
 void tud_hid_set_report_cb(uint8_t itf, uint8_t report_id, hid_report_type_t report_type, uint8_t const *buffer, uint16_t len)
 {
-	// TODO set LED based on CAPLOCK, NUMLOCK etc...
-	(void)itf;
 	(void)report_id;
-	(void)report_type;
-	(void)buffer;
+
+	// the host sets the resolution multipliers it understands, until then the wheel is in whole steps
+	if ((itf == USB_ITF_MOUSE) && (report_type == HID_REPORT_TYPE_FEATURE) && (len >= sizeof(self.mouse_feature))) {
+		self.mouse_feature = buffer[0];
+		self.wheel_rem = 0;
+		self.pan_rem = 0;
+	}
+
+	// TODO set LED based on CAPLOCK, NUMLOCK etc...
+}
+
+void tud_hid_report_complete_cb(uint8_t itf, uint8_t const *report, uint8_t len)
+{
+	(void)report;
 	(void)len;
+
+	send_next_report(itf);
+}
+
+// Batch packet: marker, seq, op count, ops... where an op is either `reg` (read), `reg | WRITE_MASK, value` (write)
+// or `VENDOR_BATCH_UPDATE, reg, mask, value` (masked write). The reply is marker, seq, number of ops done, and
+// for every op done its reply length followed by the reply. Ops whose reply might not fit are left for the host to resend.
+static void process_batch(uint8_t itf, const uint8_t *in, uint32_t in_len)
+{
+	uint8_t out[VENDOR_PACKET_SIZE];
+	uint32_t in_idx = VENDOR_BATCH_HEADER_LEN;
+	uint32_t out_idx = VENDOR_BATCH_HEADER_LEN;
+
+	out[0] = VENDOR_BATCH_MARKER;
+	out[1] = in[1];
+	out[2] = 0;
+
+	for (uint8_t i = 0; (i < in[2]) && (in_idx < in_len); ++i) {
+		const bool is_update = (in[in_idx] == VENDOR_BATCH_UPDATE);
+		const uint8_t op_len = is_update ? 4 : ((in[in_idx] & PACKET_WRITE_MASK) ? 2 : 1);
+
+		// the reply has to fit before the op runs, reads can't be undone
+		const uint8_t reply_max = is_update ? sizeof(uint8_t) : reg_reply_max_len(in[in_idx]);
+
+		if ((in_idx + op_len > in_len) || (out_idx + 1 + reply_max > sizeof(out)))
+			break;
+
+		uint8_t *reply = &out[out_idx + 1];
+		uint8_t reply_len = 0;
+
+		if (is_update)
+			reg_update_packet(in[in_idx + 1] & ~PACKET_WRITE_MASK, in[in_idx + 2], in[in_idx + 3], reply, &reply_len);
+		else
+			reg_process_packet(in[in_idx], (op_len > 1) ? in[in_idx + 1] : 0, reply, &reply_len);
+
+		in_idx += op_len;
+
+		out[out_idx] = reply_len;
+		out_idx += 1 + reply_len;
+		++out[2];
+	}
+
+	tud_vendor_n_write(itf, out, out_idx);
 }
 
 void tud_vendor_rx_cb(uint8_t itf)
 {
 //	printf("%s: itf: %d, avail: %d\r\n", __func__, itf, tud_vendor_n_available(itf));
 
-	uint8_t buff[64] = { 0 };
-	tud_vendor_n_read(itf, buff, 64);
+	uint8_t buff[VENDOR_PACKET_SIZE] = { 0 };
+	const uint32_t len = tud_vendor_n_read(itf, buff, sizeof(buff));
 //	printf("%s: %02X %02X %02X\r\n", __func__, buff[0], buff[1], buff[2]);
 
+	if ((len >= VENDOR_BATCH_HEADER_LEN) && (buff[0] == VENDOR_BATCH_MARKER)) {
+		process_batch(itf, buff, len);
+		return;
+	}
+
 	reg_process_packet(buff[0], buff[1], self.write_buffer, &self.write_len);
 
+	// the events go out on the same endpoint, the reply needs a header to be told apart from them
+	if (reg_is_bit_set(REG_ID_CF2, CF2_USB_STREAM_ON)) {
+		if (!self.write_len)
+			return;
+
+		uint8_t packet[VENDOR_REPLY_HEADER_LEN + PACKET_OUT_MAX_LEN];
+		packet[0] = VENDOR_REPLY_MARKER;
+		packet[1] = self.write_len;
+		memcpy(&packet[VENDOR_REPLY_HEADER_LEN], self.write_buffer, self.write_len);
+
+		tud_vendor_n_write(itf, packet, VENDOR_REPLY_HEADER_LEN + self.write_len);
+		return;
+	}
+
 	tud_vendor_n_write(itf, self.write_buffer, self.write_len);
 }
 
 void tud_mount_cb(void)
 {
-	// Send mods over USB by default if USB connected
-	reg_set_value(REG_ID_CFG, reg_get_value(REG_ID_CFG) | CFG_REPORT_MODS);
+	power_activity();
+
+	// Send mods over USB by default if USB connected, unless a saved config says otherwise
+	if (!settings_saved())
+		reg_set_value(REG_ID_CFG, reg_get_value(REG_ID_CFG) | CFG_REPORT_MODS);
+}
+
+void tud_umount_cb(void)
+{
+	flush_report_queues();
+
+	self.mouse_feature = 0;
+
+	self.stream.count = 0;
 }
 
-mutex_t *usb_get_mutex(void)
+void tud_suspend_cb(bool remote_wakeup_en)
 {
-	return &self.mutex;
+	(void)remote_wakeup_en;
+
+	// the host doesn't want old input once it's back
+	flush_report_queues();
 }
 
-void usb_init(void)
+void tud_resume_cb(void)
 {
-	tusb_init();
+	power_activity();
+}
+
+const struct usb_report_stats *usb_get_report_stats(void)
+{
+	return &self.stats;
+}
+
+const struct usb_task_stats *usb_get_task_stats(void)
+{
+	return &self.task_stats;
+}
 
-	keyboard_add_key_callback(&key_callback);
+static int64_t reenumerate_task(alarm_id_t id, void *user_data)
+{
+	(void)id;
+	(void)user_data;
+
+	if (!self.reenum_disconnected) {
+		tud_disconnect();
+		self.reenum_disconnected = true;
+
+		// negative value means interval since last alarm time
+		return -(REENUM_OFF_MS * 1000);
+	}
 
-	touchpad_add_touch_callback(&touch_callback);
+	tud_connect();
+	self.reenum_disconnected = false;
+	self.reenumerating = false;
+
+	return 0;
+}
+
+void usb_reenumerate(void)
+{
+	if (self.reenumerating)
+		return;
+
+	self.reenumerating = (add_alarm_in_ms(REENUM_DELAY_MS, reenumerate_task, NULL, true) > 0);
+}
+
+void usb_init(void)
+{
+	tusb_init();
 
-	// create a new interrupt that calls tud_task, and trigger that interrupt from a timer
-	irq_set_exclusive_handler(USB_LOW_PRIORITY_IRQ, low_priority_worker_irq);
-	irq_set_enabled(USB_LOW_PRIORITY_IRQ, true);
+	// tud_task runs as work in the main loop, posted from the usb irq and when a report is queued
+	irq_add_shared_handler(USBCTRL_IRQ, usb_irq, PICO_SHARED_IRQ_HANDLER_LOWEST_ORDER_PRIORITY);
 
-	mutex_init(&self.mutex);
-	add_alarm_in_us(USB_TASK_INTERVAL_US, timer_task, NULL, true);
+	// whatever the stack queued before the handler was there
+	request_task();
 }
@@ -1,7 +1,44 @@
 #pragma once
 
-typedef struct mutex mutex_t;
+#include <stdint.h>
 
-mutex_t *usb_get_mutex(void);
+// the mouse wheel and pan report 1/USB_MOUSE_WHEEL_MULTIPLIER steps once the host enables the resolution multiplier
+#define USB_MOUSE_WHEEL_MULTIPLIER	8
+
+// events pushed on the vendor interface when CF2_USB_STREAM_ON is set
+enum usb_event
+{
+	USB_EVENT_KEY = 1,	// key, state
+	USB_EVENT_TOUCH,	// x, y
+	USB_EVENT_LOCK,		// changed, state (USB_EVENT_LOCK_*)
+	USB_EVENT_GPIO,		// gpio_idx, level
+};
+
+#define USB_EVENT_LOCK_CAPS		(1 << 0)
+#define USB_EVENT_LOCK_NUM		(1 << 1)
+
+struct usb_report_stats
+{
+	uint32_t queued;	// HID reports added to a queue
+	uint32_t merged;	// mouse reports folded into an already queued one
+	uint32_t dropped;	// reports lost because a queue was full
+};
+
+struct usb_task_stats
+{
+	uint32_t wakeups;			// times the tud_task worker ran
+	uint32_t timer_wakeups;		// of those, the ones posted by the retry alarm after the work queue was full
+	uint32_t latency_max_us;	// longest time from triggering the worker to it running
+	uint32_t latency_avg_us;	// running average of the same
+};
+
+const struct usb_report_stats *usb_get_report_stats(void);
+const struct usb_task_stats *usb_get_task_stats(void);
+
+// runs tud_task and the queue flushes from the main loop soon, safe to call from an irq
+void usb_request_task(void);
+
+// drops off the bus and comes back, so the host picks up descriptor changes like the mouse polling interval
+void usb_reenumerate(void);
 
 void usb_init(void);
@@ -1,3 +1,7 @@
+#include "app_config.h"
+#include "reg.h"
+#include "usb.h"
+
 #include <tusb.h>
 
 #define CONFIG_TOTAL_LEN		(TUD_CONFIG_DESC_LEN + TUD_HID_DESC_LEN + TUD_HID_DESC_LEN + TUD_VENDOR_DESC_LEN + TUD_CDC_DESC_LEN)
@@ -16,6 +20,33 @@
 #define CDC_CMD_MAX_SIZE		8
 #define CDC_IN_OUT_MAX_SIZE		64
 
+// bInterval is the last byte of the mouse HID descriptor
+#define MOUSE_INTERVAL_OFFSET	(TUD_CONFIG_DESC_LEN + TUD_HID_DESC_LEN + TUD_HID_DESC_LEN - 1)
+
+#define HID_USAGE_DESKTOP_RES_MULTIPLIER	0x48 // Resolution Multiplier, not in every TinyUSB version
+
+// one logical collection with a 2 bit resolution multiplier feature, either 1x or USB_MOUSE_WHEEL_MULTIPLIER,
+// and the 16 bit axis it applies to
+#define HID_REPORT_DESC_HIRES_AXIS(...) \
+	HID_COLLECTION		( HID_COLLECTION_LOGICAL ), \
+		HID_USAGE_PAGE	( HID_USAGE_PAGE_DESKTOP ), \
+		HID_USAGE		( HID_USAGE_DESKTOP_RES_MULTIPLIER ), \
+		HID_LOGICAL_MIN	( 0 ), \
+		HID_LOGICAL_MAX	( 1 ), \
+		HID_PHYSICAL_MIN( 1 ), \
+		HID_PHYSICAL_MAX( USB_MOUSE_WHEEL_MULTIPLIER ), \
+		HID_REPORT_COUNT( 1 ), \
+		HID_REPORT_SIZE	( 2 ), \
+		HID_FEATURE		( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ), \
+		__VA_ARGS__, \
+		HID_PHYSICAL_MIN( 0 ), \
+		HID_PHYSICAL_MAX( 0 ), \
+		HID_LOGICAL_MIN_N( -32767, 2 ), \
+		HID_LOGICAL_MAX_N( 32767, 2 ), \
+		HID_REPORT_SIZE	( 16 ), \
+		HID_INPUT		( HID_DATA | HID_VARIABLE | HID_RELATIVE ), \
+	HID_COLLECTION_END
+
 static uint16_t temp_string[32];
 
 char const *string_descriptors[] =
@@ -56,17 +87,53 @@ uint8_t const hid_keyboard_descriptor[] =
 	TUD_HID_REPORT_DESC_KEYBOARD()
 };
 
+// buttons, 16 bit x/y, and a wheel/pan with resolution multipliers, laid out like struct mouse_report in usb.c
 uint8_t const hid_mouse_descriptor[] =
 {
-	TUD_HID_REPORT_DESC_MOUSE()
+	HID_USAGE_PAGE		( HID_USAGE_PAGE_DESKTOP ),
+	HID_USAGE			( HID_USAGE_DESKTOP_MOUSE ),
+	HID_COLLECTION		( HID_COLLECTION_APPLICATION ),
+		HID_USAGE		( HID_USAGE_DESKTOP_POINTER ),
+		HID_COLLECTION	( HID_COLLECTION_PHYSICAL ),
+			HID_USAGE_PAGE	( HID_USAGE_PAGE_BUTTON ),
+			HID_USAGE_MIN	( 1 ),
+			HID_USAGE_MAX	( 5 ),
+			HID_LOGICAL_MIN	( 0 ),
+			HID_LOGICAL_MAX	( 1 ),
+			HID_REPORT_COUNT( 5 ),
+			HID_REPORT_SIZE	( 1 ),
+			HID_INPUT		( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+			HID_REPORT_COUNT( 1 ),
+			HID_REPORT_SIZE	( 3 ),
+			HID_INPUT		( HID_CONSTANT ),
+
+			HID_USAGE_PAGE	( HID_USAGE_PAGE_DESKTOP ),
+			HID_USAGE		( HID_USAGE_DESKTOP_X ),
+			HID_USAGE		( HID_USAGE_DESKTOP_Y ),
+			HID_LOGICAL_MIN_N( -32767, 2 ),
+			HID_LOGICAL_MAX_N( 32767, 2 ),
+			HID_REPORT_COUNT( 2 ),
+			HID_REPORT_SIZE	( 16 ),
+			HID_INPUT		( HID_DATA | HID_VARIABLE | HID_RELATIVE ),
+
+			HID_REPORT_DESC_HIRES_AXIS(HID_USAGE(HID_USAGE_DESKTOP_WHEEL)),
+			HID_REPORT_DESC_HIRES_AXIS(HID_USAGE_PAGE(HID_USAGE_PAGE_CONSUMER), HID_USAGE_N(HID_USAGE_CONSUMER_AC_PAN, 2)),
+
+			// pad the feature report to a whole byte
+			HID_REPORT_COUNT( 1 ),
+			HID_REPORT_SIZE	( 4 ),
+			HID_FEATURE		( HID_CONSTANT ),
+		HID_COLLECTION_END,
+	HID_COLLECTION_END,
 };
 
+// the mouse polling interval is patched into a copy in tud_descriptor_configuration_cb
 uint8_t const config_descriptor[] =
 {
 	TUD_CONFIG_DESCRIPTOR(1, USB_ITF_MAX, 0, CONFIG_TOTAL_LEN, TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP, 100),
 
 	TUD_HID_DESCRIPTOR(USB_ITF_KEYBOARD,    4, HID_ITF_PROTOCOL_NONE, sizeof(hid_keyboard_descriptor), EPNUM_HID_KEYBOARD, CFG_TUD_HID_EP_BUFSIZE, 10),
-	TUD_HID_DESCRIPTOR(USB_ITF_MOUSE,       5, HID_ITF_PROTOCOL_NONE, sizeof(hid_mouse_descriptor),    EPNUM_HID_MOUSE,    CFG_TUD_HID_EP_BUFSIZE, 10),
+	TUD_HID_DESCRIPTOR(USB_ITF_MOUSE,       5, HID_ITF_PROTOCOL_NONE, sizeof(hid_mouse_descriptor),    EPNUM_HID_MOUSE,    CFG_TUD_HID_EP_BUFSIZE, USB_MOUSE_POLL_MS),
 
 	TUD_VENDOR_DESCRIPTOR(USB_ITF_VENDOR,   7, EPNUM_VENDOR_OUT, EPNUM_VENDOR_IN, CFG_TUD_VENDOR_EPSIZE),
 
@@ -93,7 +160,14 @@ uint8_t const *tud_descriptor_configuration_cb(uint8_t index)
 {
 	(void) index;
 
-	return config_descriptor;
+	static uint8_t descriptor[sizeof(config_descriptor)];
+
+	memcpy(descriptor, config_descriptor, sizeof(descriptor));
+
+	// full speed interrupt endpoints poll every 1 to 255 ms
+	descriptor[MOUSE_INTERVAL_OFFSET] = MAX(1, reg_get_value(REG_ID_MPI));
+
+	return descriptor;
 }
 
 uint16_t const *tud_descriptor_string_cb(uint8_t idx, uint16_t langid)
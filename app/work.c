@@ -0,0 +1,121 @@
+#include "work.h"
+
+#include <hardware/sync.h>
+#include <pico/stdlib.h>
+
+#define QUEUE_SIZE		16 // per priority, the producers don't post again while their last item is waiting
+
+struct work_item
+{
+	void (*func)(uint32_t arg);
+	uint32_t arg;
+	uint32_t post_time;
+};
+
+struct work_queue
+{
+	struct work_item items[QUEUE_SIZE];
+	uint8_t count;
+	uint8_t read_idx;
+};
+
+static struct
+{
+	struct work_queue queues[WORK_PRIO_LAST];
+
+	struct work_stats stats;
+} self;
+
+bool work_post(enum work_priority prio, void (*func)(uint32_t arg), uint32_t arg)
+{
+	struct work_queue *queue = &self.queues[prio];
+
+	const uint32_t irq = save_and_disable_interrupts();
+
+	if (queue->count >= QUEUE_SIZE) {
+		++self.stats.dropped;
+		restore_interrupts(irq);
+		return false;
+	}
+
+	struct work_item *item = &queue->items[(queue->read_idx + queue->count) % QUEUE_SIZE];
+	item->func = func;
+	item->arg = arg;
+	item->post_time = time_us_32();
+
+	++queue->count;
+
+	restore_interrupts(irq);
+
+	// the main loop may have just found the queues empty, don't let it sleep through this one
+	__sev();
+
+	return true;
+}
+
+bool work_pending(void)
+{
+	for (uint8_t i = 0; i < WORK_PRIO_LAST; ++i) {
+		if (self.queues[i].count)
+			return true;
+	}
+
+	return false;
+}
+
+bool work_run(void)
+{
+	struct work_item item;
+	bool found = false;
+
+	const uint32_t irq = save_and_disable_interrupts();
+
+	for (uint8_t i = 0; i < WORK_PRIO_LAST; ++i) {
+		struct work_queue *queue = &self.queues[i];
+
+		if (!queue->count)
+			continue;
+
+		item = queue->items[queue->read_idx];
+		queue->read_idx = (queue->read_idx + 1) % QUEUE_SIZE;
+		--queue->count;
+
+		found = true;
+		break;
+	}
+
+	restore_interrupts(irq);
+
+	if (!found)
+		return false;
+
+	const uint32_t start_time = time_us_32();
+
+	item.func(item.arg);
+
+	const uint32_t run_time = time_us_32() - start_time;
+
+	self.stats.latency_max_us = MAX(self.stats.latency_max_us, start_time - item.post_time);
+	self.stats.run_max_us = MAX(self.stats.run_max_us, run_time);
+
+	return true;
+}
+
+void work_irq_done(uint32_t start_time)
+{
+	self.stats.irq_max_us = MAX(self.stats.irq_max_us, time_us_32() - start_time);
+}
+
+const struct work_stats *work_get_stats(void)
+{
+	return &self.stats;
+}
+
+void work_reset_stats(void)
+{
+	const uint32_t irq = save_and_disable_interrupts();
+
+	self.stats = (struct work_stats){ 0 };
+
+	restore_interrupts(irq);
+}
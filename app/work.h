@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The irq handlers only capture what they need and post the rest here, the main loop runs it with the irqs enabled.
+// Higher priorities run first, items of the same priority in the order they were posted.
+enum work_priority
+{
+	WORK_PRIO_HIGH = 0,	// the puppet I2C controller is waiting on it with the clock held low
+	WORK_PRIO_NORMAL,	// key, touch and GPIO input
+	WORK_PRIO_LOW,		// usb and flash
+
+	WORK_PRIO_LAST,
+};
+
+struct work_stats
+{
+	uint32_t latency_max_us;	// longest time from posting an item to it starting
+	uint32_t run_max_us;		// longest a single item ran
+	uint32_t irq_max_us;		// longest instrumented irq handler, no other irq could run meanwhile
+	uint32_t dropped;			// items that didn't fit in their queue
+};
+
+// safe to call from irqs, false if the queue was full
+bool work_post(enum work_priority prio, void (*func)(uint32_t arg), uint32_t arg);
+
+bool work_pending(void);
+
+// runs the next item, false if there was none
+bool work_run(void);
+
+// call at the end of an irq handler with the time_us_32() from its start
+void work_irq_done(uint32_t start_time);
+
+const struct work_stats *work_get_stats(void);
+void work_reset_stats(void);
@@ -1,3 +1,6 @@
+import asyncio
+import collections
+import threading
 import usb
 
 
@@ -23,9 +26,59 @@ _REG_IND = 0x13  # interrupt pin assert duration
 _REG_CF2 = 0x14  # config 2
 _REG_TOX = 0x15  # touch delta x since last read, at most (-128 to 127)
 _REG_TOY = 0x16  # touch delta y since last read, at most (-128 to 127)
+_REG_GES = 0x17  # last touch gesture since last read
+_REG_GSX = 0x18  # gesture scroll pan steps since last read, at most (-128 to 127)
+_REG_GSY = 0x19  # gesture scroll wheel steps since last read, at most (-128 to 127)
+_REG_GCF = 0x1A  # gesture config
+_REG_SWT = 0x1B  # swipe threshold
+_REG_SWO = 0x1C  # swipe tolerance
+_REG_TXL = 0x1D  # touch delta x since last read, low byte, reading it returns TXL to TST in one burst
+_REG_TXH = 0x1E  # touch delta x since last read, high byte
+_REG_TYL = 0x1F  # touch delta y since last read, low byte
+_REG_TYH = 0x20  # touch delta y since last read, high byte
+_REG_TST = 0x21  # touch delta saturation status
+_REG_PGL = 0x22  # pointer gain at low speed (Q4)
+_REG_PGH = 0x23  # pointer gain at high speed (Q4)
+_REG_PSL = 0x24  # pointer speed up to which the low gain is used
+_REG_PSH = 0x25  # pointer speed from which the high gain is used
+_REG_PSM = 0x26  # pointer smoothing
+_REG_HQS = 0x27  # usb hid report queue stats
+_REG_UTS = 0x28  # usb task stats
+_REG_MPI = 0x29  # usb mouse polling interval
+_REG_CFS = 0x2A  # config store command/status
+_REG_GEC = 0x2B  # gpio edge capture enable
+_REG_GEV = 0x2C  # gpio edge events
+_REG_GPS = 0x2D  # gpio pin select
+_REG_GPM = 0x2E  # gpio pin mode
+_REG_GPD = 0x2F  # gpio pin pwm duty
+_REG_GFL = 0x30  # gpio pin pwm frequency, low byte
+_REG_GFH = 0x31  # gpio pin pwm frequency, high byte
+_REG_GCN = 0x32  # gpio pin counter
+_REG_GGF = 0x33  # gpio pin glitch filter
+_REG_BFT = 0x34  # backlight fade time
+_REG_BCF = 0x35  # backlight config
+_REG_BIT = 0x36  # backlight idle timeout
+_REG_BIL = 0x37  # backlight idle level
+_REG_PIT = 0x38  # power idle timeout
+_REG_PCF = 0x39  # power config
+_REG_PST = 0x3A  # power state
+_REG_PWS = 0x3B  # power wake stats
+_REG_PCK = 0x3C  # power clock stats
+_REG_WQS = 0x3D  # work queue stats
+_REG_PFS = 0x3E  # performance counter select
+_REG_PFV = 0x3F  # performance counter value
+_REG_TRC = 0x40  # trace config
+_REG_TRD = 0x41  # trace records
 
 _WRITE_MASK      = 1 << 7
 
+_PACKET_SIZE     = 64
+_BATCH_MARKER    = 0x00  # first byte of a batch packet
+_BATCH_UPDATE    = 0x00  # batch op: masked write
+_EVENT_MARKER    = 0xE0  # first byte of a pushed event packet
+_EVENT_LOST      = 1 << 0
+_REPLY_MARKER    = 0xE1  # first byte of a single register reply while streaming
+
 CFG_OVERFLOW_ON  = 1 << 0
 CFG_OVERFLOW_INT = 1 << 1
 CFG_CAPSLOCK_INT = 1 << 2
@@ -38,6 +91,86 @@ CFG_USE_MODS     = 1 << 7
 CF2_TOUCH_INT    = 1 << 0
 CF2_USB_KEYB_ON  = 1 << 1
 CF2_USB_MOUSE_ON = 1 << 2
+CF2_TOUCH_ACCEL  = 1 << 3
+CF2_USB_STREAM_ON = 1 << 4
+CF2_INT_W1C      = 1 << 5
+CF2_INT_RC       = 1 << 6
+
+_CFS_SAVE        = 0x53
+_CFS_DEFAULTS    = 0x44
+
+CFS_SAVED        = 1 << 0
+CFS_BUSY         = 1 << 1
+CFS_FAILED       = 1 << 2
+
+_GEV_COUNT_MASK  = 0x0F
+_GEV_MORE        = 1 << 6
+_GEV_OVERFLOW    = 1 << 7
+_GEV_EVENT_LEN   = 5
+
+GPM_GPIO         = 0
+GPM_PWM          = 1
+GPM_COUNTER      = 2
+GPM_REFUSED      = 1 << 7
+
+BCF_GAMMA_ON     = 1 << 0
+BCF_KEY_WAKE     = 1 << 1
+BCF_TOUCH_WAKE   = 1 << 2
+
+PCF_SLOW_CLK_ON  = 1 << 0
+PCF_DORMANT_ON   = 1 << 1
+PCF_VREG_SCALE_ON = 1 << 2
+
+POWER_ACTIVE     = 0
+POWER_IDLE       = 1
+POWER_SLOW       = 2
+
+_PFS_UPTIME      = 0x00
+_PFS_COUNTER     = 0x01
+_PFS_TIMER       = 0x10
+
+PERF_I2C_PACKETS         = 0
+PERF_USB_REPORTS_SENT    = 1
+PERF_USB_REPORTS_DROPPED = 2
+PERF_FIFO_OVERFLOWS      = 3
+PERF_INT_PULSES          = 4
+_PERF_COUNTERS           = 5
+
+PERF_TIMER_SCAN          = 0
+PERF_TIMER_PUPPET_IRQ    = 1
+PERF_TIMER_TOUCH_IRQ     = 2
+PERF_TIMER_TOUCH_READ    = 3
+_PERF_TIMERS             = 4
+
+TRC_ON           = 1 << 0
+
+_TRD_COUNT_MASK  = 0x0F
+_TRD_MORE        = 1 << 6
+_TRD_OVERFLOW    = 1 << 7
+_TRD_RECORD_LEN  = 7
+
+TRACE_SCAN_START = 1
+TRACE_SCAN_END   = 2
+TRACE_KEY        = 3
+TRACE_FIFO_PUSH  = 4
+TRACE_FIFO_POP   = 5
+TRACE_I2C        = 6
+TRACE_INT_PULSE  = 7
+TRACE_USB_KEYB   = 8
+TRACE_USB_MOUSE  = 9
+
+GCF_SWIPE_ON     = 1 << 0
+GCF_SCROLL_ON    = 1 << 1
+GCF_INERTIA_ON   = 1 << 2
+GCF_TAP_ON       = 1 << 3
+
+GESTURE_NONE        = 0
+GESTURE_TAP         = 1
+GESTURE_SWIPE_UP    = 2
+GESTURE_SWIPE_DOWN  = 3
+GESTURE_SWIPE_LEFT  = 4
+GESTURE_SWIPE_RIGHT = 5
+GESTURE_SCROLL      = 6
 
 INT_OVERFLOW     = 1 << 0
 INT_CAPSLOCK     = 1 << 1
@@ -47,6 +180,11 @@ INT_PANIC        = 1 << 4
 INT_GPIO         = 1 << 5
 INT_TOUCH        = 1 << 6
 
+TST_TX_SAT       = 1 << 0
+TST_TY_SAT       = 1 << 1
+TST_TOX_SAT      = 1 << 2
+TST_TOY_SAT      = 1 << 3
+
 KEY_CAPSLOCK     = 1 << 5
 KEY_NUMLOCK      = 1 << 6
 KEY_COUNT_MASK   = 0x1F
@@ -57,10 +195,30 @@ DIR_INPUT        = 1
 PUD_DOWN         = 0
 PUD_UP           = 1
 
+EVENT_KEY        = 1
+EVENT_TOUCH      = 2
+EVENT_LOCK       = 3
+EVENT_GPIO       = 4
+
+EVENT_LOCK_CAPS  = 1 << 0
+EVENT_LOCK_NUM   = 1 << 1
+
+GpioEdge = collections.namedtuple('GpioEdge', ['pin', 'level', 'time_us'])
+# lost is set on the first event after the firmware had to drop some
+Event = collections.namedtuple('Event', ['type', 'data0', 'data1', 'lost'])
+TraceRecord = collections.namedtuple('TraceRecord', ['time_us', 'type', 'a', 'b'])
+
 
 class I2CPuppet:
     def __init__(self, vid=0x1209, pid=0xB182):
         self._buffer = bytearray(2)
+        self._seq = 0
+        # the events iterator reads in an executor thread, whoever holds the lock reads for both sides
+        self._rx_lock = threading.Lock()
+        self._rx = bytearray()
+        self._replies = collections.deque()
+        self._events = collections.deque()
+        self._streaming = False
         self._dev = usb.core.find(idVendor=vid, idProduct=pid)
 
         if self._dev is None:
@@ -75,6 +233,10 @@ class I2CPuppet:
         if (self._ep_out is None) or (self._ep_in is None):
             raise Exception('Vendor IN or OUT endpoint not found!')
 
+        # CF2_USB_STREAM_ON is saved with the settings, the device may be streaming already.
+        # a batch reply can be told apart from events either way.
+        self._streaming = (self.batch([(_REG_CF2,)])[0][0] & CF2_USB_STREAM_ON) != 0
+
     @property
     def version(self):
         ver = self._read_register(_REG_VER)
@@ -92,6 +254,233 @@ class I2CPuppet:
     def backlight(self, value):
         self._write_register(_REG_BKL, int(255 * value))
 
+    @property
+    def backlight2(self):
+        return self._read_register(_REG_BK2) / 255
+
+    @backlight2.setter
+    def backlight2(self, value):
+        self._write_register(_REG_BK2, int(255 * value))
+
+    # in seconds, rounded to 10ms
+    @property
+    def backlight_fade(self):
+        return self._read_register(_REG_BFT) / 100
+
+    @backlight_fade.setter
+    def backlight_fade(self, value):
+        self._write_register(_REG_BFT, int(value * 100))
+
+    @property
+    def backlight_gamma(self):
+        return self._get_register_bit(_REG_BCF, 0)
+
+    @backlight_gamma.setter
+    def backlight_gamma(self, value):
+        self._update_register_bit(_REG_BCF, 0, value)
+
+    # after timeout seconds without activity the backlights dim to level (0 to 1), a timeout of 0 never dims
+    def backlight_idle(self, timeout, level=0):
+        self.batch([(_REG_BIL, int(255 * level)), (_REG_BIT, timeout)])
+
+    @property
+    def gesture(self):
+        return self._read_register(_REG_GES)
+
+    @property
+    def touch(self):
+        data = self.batch([(_REG_TXL,)])[0]
+        x = int.from_bytes(data[0:2], 'little', signed=True)
+        y = int.from_bytes(data[2:4], 'little', signed=True)
+
+        return (x, y, data[4] & (TST_TX_SAT | TST_TY_SAT) != 0)
+
+    @property
+    def hid_report_stats(self):
+        data = self.batch([(_REG_HQS,)])[0]
+
+        return tuple(int.from_bytes(data[i:i + 4], 'little') for i in range(0, 12, 4))
+
+    @property
+    def usb_task_stats(self):
+        data = self.batch([(_REG_UTS,)])[0]
+
+        return tuple(int.from_bytes(data[i:i + 4], 'little') for i in range(0, 16, 4))
+
+    # seconds without activity before the system sleeps, 0 never sleeps
+    @property
+    def power_idle_timeout(self):
+        return self._read_register(_REG_PIT)
+
+    @power_idle_timeout.setter
+    def power_idle_timeout(self, value):
+        self._write_register(_REG_PIT, value)
+
+    @property
+    def power_config(self):
+        return self._read_register(_REG_PCF)
+
+    @power_config.setter
+    def power_config(self, value):
+        self._write_register(_REG_PCF, value)
+
+    # returns the state and the ms spent active, asleep and asleep with the clock lowered
+    @property
+    def power_state(self):
+        data = self.batch([(_REG_PST,)])[0]
+
+        return (data[0],) + tuple(int.from_bytes(data[i:i + 4], 'little') for i in range(1, 13, 4))
+
+    # returns the wakeups, the ones from dormant, and the last and longest wake up latency in us
+    @property
+    def power_wake_stats(self):
+        data = self.batch([(_REG_PWS,)])[0]
+
+        return tuple(int.from_bytes(data[i:i + 4], 'little') for i in range(0, 16, 4))
+
+    # returns the system clock in kHz, and the times it was raised, lowered and kept up for an I2C transfer
+    @property
+    def power_clock_stats(self):
+        data = self.batch([(_REG_PCK,)])[0]
+
+        return tuple(int.from_bytes(data[i:i + 4], 'little') for i in range(0, 16, 4))
+
+    def reset_power_stats(self):
+        self._write_register(_REG_PST, 0)
+
+    # returns the longest queue latency, work run time and irq handler time in us, and the dropped work items
+    @property
+    def work_stats(self):
+        data = self.batch([(_REG_WQS,)])[0]
+
+        return tuple(int.from_bytes(data[i:i + 4], 'little') for i in range(0, 16, 4))
+
+    def reset_work_stats(self):
+        self._write_register(_REG_WQS, 0)
+
+    # returns the uptime in ms, the PERF_* counters, and the PERF_TIMER_* timers as (count, min, avg, max) in us
+    def perf_counters(self, reset=False):
+        selects = [_PFS_UPTIME]
+        selects += [_PFS_COUNTER + i for i in range(_PERF_COUNTERS)]
+        selects += [_PFS_TIMER + i for i in range(_PERF_TIMERS)]
+
+        ops = []
+        for select in selects:
+            ops += [(_REG_PFS, select), (_REG_PFV,)]
+
+        if reset:
+            ops.append((_REG_PFV, 0))
+
+        data = self.batch(ops)[1::2]
+        if not data[0]:
+            raise Exception('The firmware was built without PERF_COUNTERS!')
+
+        uptime = int.from_bytes(data[0], 'little')
+        counters = [int.from_bytes(d, 'little') for d in data[1:1 + _PERF_COUNTERS]]
+        timers = [tuple(int.from_bytes(d[i:i + 4], 'little') for i in range(0, 16, 4)) for d in data[1 + _PERF_COUNTERS:]]
+
+        return uptime, counters, timers
+
+    @property
+    def trace_config(self):
+        return self._read_register(_REG_TRC)
+
+    @trace_config.setter
+    def trace_config(self, value):
+        self._write_register(_REG_TRC, value)
+
+    # stops the recording and empties the ring, returns the TraceRecord tuples oldest first and whether older ones
+    # were overwritten. Set trace_config to TRC_ON to record again.
+    def trace_dump(self):
+        self.trace_config = 0
+
+        records = []
+        lost = False
+
+        while True:
+            # a few reads per batch packet, the ones past the end of the ring just come back empty
+            for data in self.batch([(_REG_TRD,)] * 8):
+                if not data:
+                    raise Exception('The firmware was built without TRACE_RING!')
+
+                lost |= (data[0] & _TRD_OVERFLOW) != 0
+
+                for i in range(data[0] & _TRD_COUNT_MASK):
+                    record = data[1 + i * _TRD_RECORD_LEN:1 + (i + 1) * _TRD_RECORD_LEN]
+                    records.append(TraceRecord(int.from_bytes(record[0:4], 'little'), record[4], record[5], record[6]))
+
+            if not data[0] & _TRD_MORE:
+                return (records, lost)
+
+    @property
+    def gpio_edge_capture(self):
+        return self._read_register(_REG_GEC)
+
+    @gpio_edge_capture.setter
+    def gpio_edge_capture(self, value):
+        self._write_register(_REG_GEC, value)
+
+    # returns the queued GpioEdge tuples and whether some were lost
+    def gpio_edges(self):
+        edges = []
+        lost = False
+
+        while True:
+            data = self.batch([(_REG_GEV,)])[0]
+            lost |= (data[0] & _GEV_OVERFLOW) != 0
+
+            for i in range(data[0] & _GEV_COUNT_MASK):
+                event = data[1 + i * _GEV_EVENT_LEN:1 + (i + 1) * _GEV_EVENT_LEN]
+                edges.append(GpioEdge(event[0] & 0x07, event[0] >> 7, int.from_bytes(event[1:5], 'little')))
+
+            if not data[0] & _GEV_MORE:
+                return (edges, lost)
+
+    # returns False if the pin can't do the mode, or another pin on its PWM slice is set up differently
+    def gpio_mode(self, pin, mode):
+        return self.batch([(_REG_GPS, pin), (_REG_GPM, mode), (_REG_GPM,)])[2][0] == mode
+
+    # returns False if another PWM pin on the slice runs at a different frequency
+    def gpio_pwm(self, pin, freq, duty):
+        ops = [(_REG_GPS, pin), (_REG_GPD, duty), (_REG_GFL, freq & 0xFF), (_REG_GFH, freq >> 8), (_REG_GPM,)]
+
+        return (self.batch(ops)[4][0] & GPM_REFUSED) == 0
+
+    # edges are reported once the input was stable for stable_ms, 0 turns the filter off
+    def gpio_filter(self, pin, stable_ms):
+        self.batch([(_REG_GPS, pin), (_REG_GGF, stable_ms)])
+
+    # returns the edge count and the edges per second
+    def gpio_counter(self, pin, reset=False):
+        ops = [(_REG_GPS, pin), (_REG_GCN,)]
+        if reset:
+            ops.append((_REG_GCN, 0))
+
+        data = self.batch(ops)[1]
+
+        return (int.from_bytes(data[0:4], 'little'), int.from_bytes(data[4:8], 'little'))
+
+    @property
+    def config_status(self):
+        return self._read_register(_REG_CFS)
+
+    # the registers are saved in the background, poll config_status for CFS_BUSY to clear
+    def save_config(self):
+        self._write_register(_REG_CFS, _CFS_SAVE)
+
+    # the device resets afterwards, so this object has to be recreated
+    def restore_defaults(self):
+        self._write_register(_REG_CFS, _CFS_DEFAULTS)
+
+    @property
+    def mouse_poll_interval(self):
+        return self._read_register(_REG_MPI)
+
+    # the device re-enumerates to apply it, so this object has to be recreated afterwards
+    @mouse_poll_interval.setter
+    def mouse_poll_interval(self, value):
+        self._write_register(_REG_MPI, value)
+
     @property
     def address(self):
         return self._read_register(_REG_ADR)
@@ -100,29 +489,154 @@ class I2CPuppet:
     def address(self, value):
         self._write_register(_REG_ADR, value)
 
+    @property
+    def streaming(self):
+        return self._streaming
+
+    @streaming.setter
+    def streaming(self, value):
+        self._update_register_bit(_REG_CF2, 4, value)
+        self._streaming = value
+
+    # yields Event tuples pushed by the device, needs streaming enabled
+    async def events(self, timeout=100):
+        loop = asyncio.get_running_loop()
+
+        while True:
+            while self._events:
+                yield self._events.popleft()
+
+            try:
+                await loop.run_in_executor(None, self._poll_frames, timeout)
+            except usb.core.USBTimeoutError:
+                pass
+
+    def _poll_frames(self, timeout):
+        with self._rx_lock:
+            self._read_frames(timeout)
+
+    def _frame_len(self):
+        if self._rx[0] == _EVENT_MARKER:
+            return 3 + 3 * self._rx[2] if len(self._rx) >= 3 else None
+
+        if self._rx[0] == _REPLY_MARKER:
+            return 2 + self._rx[1] if len(self._rx) >= 2 else None
+
+        if self._rx[0] == _BATCH_MARKER:
+            if len(self._rx) < 3:
+                return None
+
+            idx = 3
+            for _ in range(self._rx[2]):
+                if idx >= len(self._rx):
+                    return None
+
+                idx += 1 + self._rx[idx]
+
+            return idx
+
+        # a single register reply sent while not streaming, it's whatever came in
+        return len(self._rx)
+
+    # replies and pushed events share the IN endpoint and can arrive glued together or split, so sort them out here,
+    # only with _rx_lock held
+    def _read_frames(self, timeout=None):
+        self._rx += self._dev.read(self._ep_in, _PACKET_SIZE, timeout)
+
+        while self._rx:
+            frame_len = self._frame_len()
+            if (frame_len is None) or (frame_len > len(self._rx)):
+                return
+
+            frame = bytes(self._rx[:frame_len])
+            del self._rx[:frame_len]
+
+            if frame[0] != _EVENT_MARKER:
+                self._replies.append(frame)
+                continue
+
+            for i in range(frame[2]):
+                ev_type, data0, data1 = frame[3 + 3 * i:6 + 3 * i]
+
+                if ev_type == EVENT_TOUCH:
+                    data0 = data0 - 256 if data0 > 127 else data0
+                    data1 = data1 - 256 if data1 > 127 else data1
+
+                self._events.append(Event(ev_type, data0, data1, (i == 0) and (frame[1] & _EVENT_LOST) != 0))
+
     def _read_register(self, reg):
-        self._buffer[0] = reg
-        self._dev.write(self._ep_out, self._buffer[:1])
+        if self._streaming:
+            return self.batch([(reg,)])[0][0]
 
-        return self._dev.read(self._ep_in, 1)[0]
+        with self._rx_lock:
+            self._buffer[0] = reg
+            self._dev.write(self._ep_out, self._buffer[:1])
+
+            return self._dev.read(self._ep_in, 1)[0]
 
     def _write_register(self, reg, value):
         self._buffer[0] = reg | _WRITE_MASK
         self._buffer[1] = value
         self._dev.write(self._ep_out, self._buffer)
 
-    def _update_register_bit(self, reg, bit, value):
+    # ops are (reg,) to read, (reg, value) to write or (reg, mask, value) to update some bits,
+    # returns the reply bytes of every op, using as few USB round trips as possible
+    def batch(self, ops):
+        ops = [self._encode_op(op) for op in ops]
+        results = []
+
+        while ops:
+            self._seq = (self._seq + 1) & 0xFF
+
+            packet = bytearray([_BATCH_MARKER, self._seq, 0])
+            for op in ops[:255]:
+                if len(packet) + len(op) > _PACKET_SIZE:
+                    break
+
+                packet += op
+                packet[2] += 1
+
+            self._dev.write(self._ep_out, packet)
+
+            # the events thread may have read the reply already, so check before every read
+            with self._rx_lock:
+                while not self._replies:
+                    self._read_frames()
+
+                reply = self._replies.popleft()
+            if (reply[0] != _BATCH_MARKER) or (reply[1] != self._seq):
+                raise Exception('Unexpected batch reply!')
 
-        reg_val = self._read_register(reg)
-        old_val = reg_val
+            done = reply[2]
+            if done == 0:
+                raise Exception('Batch op not processed!')
 
-        if value:
-            reg_val |= (1 << bit)
-        else:
-            reg_val &= ~(1 << bit)
+            idx = 3
+            for _ in range(done):
+                results.append(bytes(reply[idx + 1:idx + 1 + reply[idx]]))
+                idx += 1 + reply[idx]
 
-        if reg_val != old_val:
-            self._write_register(reg, reg_val)
+            ops = ops[done:]
+
+        return results
+
+    def read_registers(self, regs):
+        return [r[0] for r in self.batch((reg,) for reg in regs)]
+
+    def write_registers(self, values):
+        self.batch((reg, value) for reg, value in values.items())
+
+    def _encode_op(self, op):
+        if len(op) == 1:
+            return bytes([op[0]])
+
+        if len(op) == 2:
+            return bytes([op[0] | _WRITE_MASK, op[1]])
+
+        return bytes([_BATCH_UPDATE, op[0], op[1], op[2]])
+
+    def _update_register_bit(self, reg, bit, value):
+        self.batch([(reg, 1 << bit, 0xFF if value else 0x00)])
 
     def _get_register_bit(self, reg, bit):
         return self._read_register(reg) & (1 << bit) != 0
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+# Dumps the trace ring of the keyboard over USB and writes it as a Chrome trace JSON timeline, open it in
+# https://ui.perfetto.dev or chrome://tracing. Recording is turned back on afterwards.
+#
+#   python3 puppet_trace.py trace.json
+
+import json
+import sys
+
+import i2c_puppet
+
+
+_KEY_STATES = ['idle', 'pressed', 'hold', 'released']
+
+# one row in the viewer per kind of record
+_ROWS = {
+    i2c_puppet.TRACE_SCAN_START: (1, 'scan'),
+    i2c_puppet.TRACE_SCAN_END:   (1, 'scan'),
+    i2c_puppet.TRACE_KEY:        (2, 'keys'),
+    i2c_puppet.TRACE_FIFO_PUSH:  (3, 'fifo'),
+    i2c_puppet.TRACE_FIFO_POP:   (3, 'fifo'),
+    i2c_puppet.TRACE_I2C:        (4, 'i2c'),
+    i2c_puppet.TRACE_INT_PULSE:  (5, 'int'),
+    i2c_puppet.TRACE_USB_KEYB:   (6, 'usb'),
+    i2c_puppet.TRACE_USB_MOUSE:  (6, 'usb'),
+}
+
+
+def key_name(key):
+    return repr(chr(key)) if 0x20 < key < 0x7F else '0x{:02X}'.format(key)
+
+
+def key_state(state):
+    return _KEY_STATES[state] if state < len(_KEY_STATES) else str(state)
+
+
+def describe(record):
+    if record.type == i2c_puppet.TRACE_KEY:
+        return 'key {} {}'.format(key_name(record.a), key_state(record.b)), {}
+
+    if record.type == i2c_puppet.TRACE_FIFO_PUSH:
+        return 'push {} {}'.format(key_name(record.a), key_state(record.b)), {}
+
+    if record.type == i2c_puppet.TRACE_FIFO_POP:
+        if not record.a:
+            return 'pop empty', {}
+
+        return 'pop {} {}'.format(key_name(record.a), key_state(record.b)), {}
+
+    if record.type == i2c_puppet.TRACE_I2C:
+        reg = record.a & ~i2c_puppet._WRITE_MASK
+        if record.a & i2c_puppet._WRITE_MASK:
+            return 'write 0x{:02X}'.format(reg), {'value': '0x{:02X}'.format(record.b)}
+
+        return 'read 0x{:02X}'.format(reg), {}
+
+    if record.type == i2c_puppet.TRACE_INT_PULSE:
+        return 'INT', {'INT': '0x{:02X}'.format(record.a)}
+
+    if record.type == i2c_puppet.TRACE_USB_KEYB:
+        return 'keyboard report', {'modifier': '0x{:02X}'.format(record.a), 'keycode': '0x{:02X}'.format(record.b)}
+
+    if record.type == i2c_puppet.TRACE_USB_MOUSE:
+        return 'mouse report', {'buttons': '0x{:02X}'.format(record.a)}
+
+    return 'type {}'.format(record.type), {'a': record.a, 'b': record.b}
+
+
+def to_chrome_trace(records, lost):
+    events = []
+
+    for tid, name in sorted(set(_ROWS.values())):
+        events.append({'ph': 'M', 'name': 'thread_name', 'pid': 0, 'tid': tid, 'args': {'name': name}})
+
+    if lost:
+        events.append({'ph': 'i', 's': 'g', 'name': 'older records overwritten', 'pid': 0, 'tid': 0, 'ts': 0})
+
+    # the firmware time is a 32-bit us counter, it wraps around every ~71 minutes
+    offset = 0
+    last = None
+    start = None
+    scanning = False
+
+    for record in records:
+        if (last is not None) and (record.time_us < last):
+            offset += 1 << 32
+        last = record.time_us
+
+        time = record.time_us + offset
+        if start is None:
+            start = time
+
+        tid = _ROWS.get(record.type, (7, 'other'))[0]
+        event = {'pid': 0, 'tid': tid, 'ts': time - start}
+
+        if record.type == i2c_puppet.TRACE_SCAN_START:
+            event.update({'ph': 'B', 'name': 'scan'})
+            scanning = True
+        elif record.type == i2c_puppet.TRACE_SCAN_END:
+            # the start of the oldest scan may have been overwritten
+            if not scanning:
+                continue
+
+            event.update({'ph': 'E', 'name': 'scan'})
+            scanning = False
+        else:
+            name, args = describe(record)
+            event.update({'ph': 'i', 's': 't', 'name': name, 'args': args})
+
+        events.append(event)
+
+    return {'traceEvents': events, 'displayTimeUnit': 'ms'}
+
+
+def main():
+    if len(sys.argv) != 2:
+        print('usage: {} <trace.json>'.format(sys.argv[0]))
+        return 1
+
+    puppet = i2c_puppet.I2CPuppet()
+
+    records, lost = puppet.trace_dump()
+    puppet.trace_config = i2c_puppet.TRC_ON
+
+    with open(sys.argv[1], 'w') as f:
+        json.dump(to_chrome_trace(records, lost), f)
+
+    print('{} records{}'.format(len(records), ', older ones were overwritten' if lost else ''))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,547 @@
+#include "sim.h"
+
+#include <RP2040.h>
+#include <hardware/clocks.h>
+#include <hardware/gpio.h>
+#include <pico/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tusb.h>
+
+#include "fifo.h"
+#include "reg.h"
+#include "trace.h"
+
+#define MAX_SAMPLES			8192
+#define MAX_PENDING			32
+#define MAX_KEYS_DOWN		4
+
+#define SETTLE_US			10000  // registers written through the puppet I2C before the load starts
+#define DRAIN_US			5000   // the trace ring and the FIFO are emptied at least this often
+#define DRAIN_END_US		500000 // time after the load for the last reports to come out
+
+#define KEY_DWELL_MIN_MS	40
+#define KEY_DWELL_MAX_MS	140
+#define KEY_GAP_MIN_MS		60     // between two presses, so ~5.5 keys per second and some rollover
+#define KEY_GAP_MAX_MS		300
+#define KEY_REPRESS_MS		50     // time a key stays up before it's pressed again
+
+#define TOUCH_PERIOD_MS		8      // motion reports while a finger moves, like the trackpad's
+#define TOUCH_MOVE_MIN_MS	100
+#define TOUCH_MOVE_MAX_MS	400
+#define TOUCH_IDLE_MIN_MS	200
+#define TOUCH_IDLE_MAX_MS	1000
+#define TOUCH_DELTA_MAX		8
+
+// Latency of the input paths under a synthetic load of typing and trackpad motion, on the virtual clock of the
+// sim. The firmware itself takes no time in the sim, so this is what the scan period, the INT pulse, the work queue
+// and the USB polling add up to; tune REG_FRQ, REG_HLD and REG_IND against it, and diff the JSON between builds.
+//
+//   i2c_puppet_bench [-s seconds] [-r seed] [-f frq] [-h hld] [-i ind] [-j]
+//
+// Every path is timed from the matrix switch closing or opening, or from the trackpad motion pin falling:
+//   key_to_fifo   the event is in REG_FIF, from the FIFO_PUSH trace record
+//   key_to_int    the INT pin is pulsed for it, from the INT_PULSE trace record
+//   key_to_hid    its report is handed to tud_hid_n_keyboard_report, from the USB_KEYB trace record
+//   touch_to_hid  the mouse report carrying the motion is handed to tud_hid_n_report, from USB_MOUSE
+//
+// The host empties the FIFO between steps. Events that can't be matched to a stimulus are counted as unmatched,
+// a non-zero count means the matching below no longer fits what the firmware does.
+
+enum path
+{
+	PATH_KEY_TO_FIFO = 0,
+	PATH_KEY_TO_INT,
+	PATH_KEY_TO_HID,
+	PATH_TOUCH_TO_HID,
+
+	PATH_LAST,
+};
+
+static const char * const path_names[PATH_LAST] =
+{
+	[PATH_KEY_TO_FIFO]	= "key_to_fifo",
+	[PATH_KEY_TO_INT]	= "key_to_int",
+	[PATH_KEY_TO_HID]	= "key_to_hid",
+	[PATH_TOUCH_TO_HID]	= "touch_to_hid",
+};
+
+struct key_pos
+{
+	uint8_t row;
+	uint8_t col;
+	char key;			// as it comes out of the FIFO, CFG_USE_MODS lower cases the letters
+};
+
+// the letters and the space bar of the bbq20kbd matrix, see kbd_entries in keyboard.c
+static const struct key_pos keys[] =
+{
+	{ 0, 1, 'w' }, { 0, 2, 'g' }, { 0, 3, 's' }, { 0, 4, 'l' }, { 0, 5, 'h' },
+	{ 1, 1, 'q' }, { 1, 2, 'r' }, { 1, 3, 'e' }, { 1, 4, 'o' }, { 1, 5, 'u' },
+	{ 2, 2, 'f' }, { 2, 4, 'k' }, { 2, 5, 'j' },
+	{ 3, 1, ' ' }, { 3, 2, 'c' }, { 3, 3, 'z' }, { 3, 4, 'm' }, { 3, 5, 'n' },
+	{ 4, 2, 't' }, { 4, 3, 'd' }, { 4, 4, 'i' }, { 4, 5, 'y' },
+	{ 5, 2, 'v' }, { 5, 3, 'x' }, { 5, 5, 'b' },
+	{ 6, 1, 'a' }, { 6, 3, 'p' },
+};
+
+static const uint8_t row_pins[NUM_OF_ROWS] = { PINS_ROWS };
+static const uint8_t col_pins[NUM_OF_COLS] = { PINS_COLS };
+
+static const uint8_t hid_codes[128][2] = { HID_ASCII_TO_KEYCODE };
+
+struct edge
+{
+	char key;
+	uint8_t state;		// enum key_state
+	uint64_t time_us;
+};
+
+struct samples
+{
+	uint32_t values[MAX_SAMPLES];
+	uint32_t count;
+};
+
+static struct
+{
+	uint32_t seconds;
+	uint32_t seed;
+	int frq;
+	int hld;
+	int ind;
+	bool json;
+
+	uint32_t rng;
+	uint64_t start_us;
+	uint64_t end_us;
+	bool configured;
+	uint64_t next_drain_us;
+
+	// typing
+	uint64_t next_press_us;
+	struct
+	{
+		uint8_t idx;	// into keys
+		uint64_t release_us;
+	} down[MAX_KEYS_DOWN];
+	uint8_t down_count;
+	uint64_t up_since_us[count_of(keys)];
+
+	// trackpad
+	uint64_t next_touch_us;
+	uint64_t move_end_us;
+
+	// stimuli waiting for their event, oldest first
+	struct edge edges[MAX_PENDING];
+	uint8_t edge_count;
+
+	struct edge hid[MAX_PENDING];
+	uint8_t hid_count;
+
+	uint64_t touches[MAX_PENDING];
+	uint8_t touch_count;
+
+	// the key event the next INT pulse belongs to
+	bool int_waiting;
+	uint64_t int_edge_us;
+
+	struct samples samples[PATH_LAST];
+	uint32_t unmatched;
+	bool overflow;
+} self;
+
+// xorshift32, so a seed gives the same run everywhere
+static uint32_t random_u32(void)
+{
+	self.rng ^= self.rng << 13;
+	self.rng ^= self.rng >> 17;
+	self.rng ^= self.rng << 5;
+
+	return self.rng;
+}
+
+static uint32_t random_range(uint32_t min, uint32_t max)
+{
+	return min + (random_u32() % (max - min + 1));
+}
+
+static void sample(enum path path, uint64_t from_us, uint64_t to_us)
+{
+	struct samples *samples = &self.samples[path];
+
+	if (samples->count < MAX_SAMPLES)
+		samples->values[samples->count++] = (uint32_t)(to_us - from_us);
+}
+
+static void remove_at(void *items, uint8_t *count, size_t size, uint8_t idx)
+{
+	--*count;
+	memmove((uint8_t *)items + idx * size, (uint8_t *)items + (idx + 1) * size, (*count - idx) * size);
+}
+
+static void key_event(char key, uint8_t state, uint64_t time_us)
+{
+	self.int_waiting = false;
+
+	// holds have no edge, and no report
+	uint8_t i;
+	for (i = 0; i < self.edge_count; ++i) {
+		if ((self.edges[i].key == key) && (self.edges[i].state == state))
+			break;
+	}
+
+	if (i == self.edge_count) {
+		if (state != KEY_STATE_HOLD)
+			++self.unmatched;
+		return;
+	}
+
+	const struct edge edge = self.edges[i];
+	remove_at(self.edges, &self.edge_count, sizeof(self.edges[0]), i);
+
+	sample(PATH_KEY_TO_FIFO, edge.time_us, time_us);
+
+	self.int_waiting = true;
+	self.int_edge_us = edge.time_us;
+
+	// the reports go out in the order of the events
+	if (self.hid_count < MAX_PENDING)
+		self.hid[self.hid_count++] = edge;
+}
+
+static void keyboard_report(uint8_t keycode, uint64_t time_us)
+{
+	if (!self.hid_count) {
+		++self.unmatched;
+		return;
+	}
+
+	const struct edge edge = self.hid[0];
+	remove_at(self.hid, &self.hid_count, sizeof(self.hid[0]), 0);
+
+	const uint8_t expected = (edge.state == KEY_STATE_PRESSED) ? hid_codes[(uint8_t)edge.key][1] : 0;
+	if (keycode != expected) {
+		++self.unmatched;
+		return;
+	}
+
+	sample(PATH_KEY_TO_HID, edge.time_us, time_us);
+}
+
+// everything traced since the last step happened after the stimuli of that step
+static void drain_trace(void)
+{
+	const uint64_t now = time_us_64();
+	struct trace_record record;
+
+	if (trace_take_overflow())
+		self.overflow = true;
+
+	// the touches that were waiting before this drain, a report from it carries their motion
+	const uint8_t touch_count = self.touch_count;
+	bool mouse_report = false;
+
+	while (trace_pop(&record)) {
+		const uint64_t time_us = now - (uint32_t)(time_us_32() - record.time);
+
+		switch (record.type) {
+		case TRACE_FIFO_PUSH:
+			key_event(record.a, record.b, time_us);
+			break;
+
+		case TRACE_INT_PULSE:
+			if (self.int_waiting && (record.a & INT_KEY))
+				sample(PATH_KEY_TO_INT, self.int_edge_us, time_us);
+
+			self.int_waiting = false;
+			break;
+
+		case TRACE_USB_KEYB:
+			keyboard_report(record.b, time_us);
+			break;
+
+		case TRACE_USB_MOUSE:
+			if (mouse_report)
+				break;
+
+			for (uint8_t i = 0; i < touch_count; ++i)
+				sample(PATH_TOUCH_TO_HID, self.touches[i], time_us);
+
+			self.touch_count -= touch_count;
+			memmove(&self.touches[0], &self.touches[touch_count], self.touch_count * sizeof(self.touches[0]));
+			mouse_report = true;
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+static void drain_host(void)
+{
+	while (fifo_count())
+		fifo_dequeue();
+
+	struct sim_hid_report report;
+	while (sim_usb_pop_report(&report))
+		;
+}
+
+static void press(void)
+{
+	const uint64_t now = time_us_64();
+
+	if (self.down_count >= MAX_KEYS_DOWN)
+		return;
+
+	// a key that's up and has been for a while
+	uint8_t idx;
+	do {
+		idx = random_u32() % count_of(keys);
+
+		bool down = false;
+		for (uint8_t i = 0; i < self.down_count; ++i)
+			down |= (self.down[i].idx == idx);
+
+		if (!down && (now - self.up_since_us[idx] >= KEY_REPRESS_MS * 1000))
+			break;
+	} while (true);
+
+	sim_gpio_connect(row_pins[keys[idx].row], col_pins[keys[idx].col], true);
+
+	self.down[self.down_count].idx = idx;
+	self.down[self.down_count].release_us = now + random_range(KEY_DWELL_MIN_MS * 1000, KEY_DWELL_MAX_MS * 1000);
+	++self.down_count;
+
+	if (self.edge_count < MAX_PENDING)
+		self.edges[self.edge_count++] = (struct edge){ keys[idx].key, KEY_STATE_PRESSED, now };
+}
+
+static void release(uint8_t down_idx)
+{
+	const uint64_t now = time_us_64();
+	const uint8_t idx = self.down[down_idx].idx;
+
+	sim_gpio_connect(row_pins[keys[idx].row], col_pins[keys[idx].col], false);
+
+	self.up_since_us[idx] = now;
+	remove_at(self.down, &self.down_count, sizeof(self.down[0]), down_idx);
+
+	if (self.edge_count < MAX_PENDING)
+		self.edges[self.edge_count++] = (struct edge){ keys[idx].key, KEY_STATE_RELEASED, now };
+}
+
+static int delta(void)
+{
+	const int value = random_range(1, TOUCH_DELTA_MAX);
+
+	return (random_u32() & 1) ? value : -value;
+}
+
+static void touch(void)
+{
+	const uint64_t now = time_us_64();
+
+	// motion while the pin is still low only adds up, it's the edge that starts the path
+	if (gpio_get(PIN_TP_MOTION) && (self.touch_count < MAX_PENDING))
+		self.touches[self.touch_count++] = now;
+
+	sim_touch(delta(), delta());
+
+	if (now + TOUCH_PERIOD_MS * 1000 < self.move_end_us) {
+		self.next_touch_us = now + TOUCH_PERIOD_MS * 1000;
+	} else {
+		self.next_touch_us = now + random_range(TOUCH_IDLE_MIN_MS * 1000, TOUCH_IDLE_MAX_MS * 1000);
+		self.move_end_us = self.next_touch_us + random_range(TOUCH_MOVE_MIN_MS * 1000, TOUCH_MOVE_MAX_MS * 1000);
+	}
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+	const uint32_t x = *(const uint32_t *)a;
+	const uint32_t y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+// nearest rank
+static uint32_t percentile(const struct samples *samples, uint32_t pct)
+{
+	if (!samples->count)
+		return 0;
+
+	const uint32_t rank = (pct * samples->count + 99) / 100;
+
+	return samples->values[MAX(rank, 1) - 1];
+}
+
+static void report(void)
+{
+	for (uint i = 0; i < PATH_LAST; ++i)
+		qsort(self.samples[i].values, self.samples[i].count, sizeof(uint32_t), compare_u32);
+
+	if (self.json) {
+		printf("{\"config\": {\"seconds\": %u, \"seed\": %u, \"frq\": %u, \"hld_ms\": %u, \"ind\": %u, \"mouse_poll_ms\": %u},\n",
+			self.seconds, self.seed, reg_get_value(REG_ID_FRQ), reg_get_value(REG_ID_HLD) * 10, reg_get_value(REG_ID_IND),
+			USB_MOUSE_POLL_MS);
+		printf(" \"paths\": {\n");
+
+		for (uint i = 0; i < PATH_LAST; ++i) {
+			const struct samples *samples = &self.samples[i];
+
+			printf("  \"%s\": {\"samples\": %u, \"p50_us\": %u, \"p99_us\": %u, \"max_us\": %u}%s\n", path_names[i],
+				samples->count, percentile(samples, 50), percentile(samples, 99),
+				samples->count ? samples->values[samples->count - 1] : 0, (i + 1 < PATH_LAST) ? "," : "");
+		}
+
+		printf(" },\n \"unmatched\": %u, \"trace_overflow\": %s}\n", self.unmatched, self.overflow ? "true" : "false");
+	} else {
+		printf("%u s, seed %u, FRQ %u ms, HLD %u ms, IND %u ms, mouse poll %u ms\n\n", self.seconds, self.seed,
+			reg_get_value(REG_ID_FRQ), reg_get_value(REG_ID_HLD) * 10, reg_get_value(REG_ID_IND), USB_MOUSE_POLL_MS);
+		printf("%-14s %8s %10s %10s %10s\n", "path", "samples", "p50 ms", "p99 ms", "max ms");
+
+		for (uint i = 0; i < PATH_LAST; ++i) {
+			const struct samples *samples = &self.samples[i];
+
+			printf("%-14s %8u %10.3f %10.3f %10.3f\n", path_names[i], samples->count, percentile(samples, 50) / 1000.0,
+				percentile(samples, 99) / 1000.0, (samples->count ? samples->values[samples->count - 1] : 0) / 1000.0);
+		}
+
+		printf("\n%u unmatched%s\n", self.unmatched, self.overflow ? ", the trace ring overflowed" : "");
+	}
+
+	exit((self.unmatched || self.overflow) ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+static void configure(void)
+{
+	if (self.frq >= 0)
+		sim_i2c_write(REG_ID_FRQ, self.frq);
+
+	if (self.hld >= 0)
+		sim_i2c_write(REG_ID_HLD, self.hld);
+
+	if (self.ind >= 0)
+		sim_i2c_write(REG_ID_IND, self.ind);
+
+	trace_clear();
+	trace_take_overflow();
+
+	self.start_us = time_us_64() + SETTLE_US;
+	self.end_us = self.start_us + (uint64_t)self.seconds * 1000000;
+	self.next_press_us = self.start_us;
+	self.next_touch_us = self.start_us;
+	self.move_end_us = self.start_us + random_range(TOUCH_MOVE_MIN_MS * 1000, TOUCH_MOVE_MAX_MS * 1000);
+
+	self.configured = true;
+}
+
+uint64_t sim_script_next(void)
+{
+	const uint64_t now = time_us_64();
+
+	if (!self.configured)
+		return now;
+
+	uint64_t next = self.next_drain_us;
+
+	if (now < self.end_us) {
+		next = MIN(next, self.next_press_us);
+		next = MIN(next, self.next_touch_us);
+	}
+
+	for (uint8_t i = 0; i < self.down_count; ++i)
+		next = MIN(next, self.down[i].release_us);
+
+	return MAX(next, now);
+}
+
+void sim_script_run(void)
+{
+	const uint64_t now = time_us_64();
+
+	if (!self.configured) {
+		configure();
+		return;
+	}
+
+	drain_trace();
+	drain_host();
+	self.next_drain_us = now + DRAIN_US;
+
+	if (now >= self.start_us) {
+		for (int8_t i = self.down_count - 1; i >= 0; --i) {
+			if (self.down[i].release_us <= now)
+				release(i);
+		}
+
+		if ((now < self.end_us) && (now >= self.next_press_us)) {
+			press();
+			self.next_press_us = now + random_range(KEY_GAP_MIN_MS * 1000, KEY_GAP_MAX_MS * 1000);
+		}
+
+		if ((now < self.end_us) && (now >= self.next_touch_us))
+			touch();
+	}
+
+	if ((now >= self.end_us + DRAIN_END_US) && !self.down_count)
+		report();
+}
+
+void NVIC_SystemReset(void)
+{
+	fprintf(stderr, "the firmware reset itself\n");
+
+	exit(2);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-s seconds] [-r seed] [-f frq] [-h hld] [-i ind] [-j]\n", name);
+
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	self.seconds = 60;
+	self.seed = 1;
+	self.frq = -1;
+	self.hld = -1;
+	self.ind = -1;
+
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-j")) {
+			self.json = true;
+			continue;
+		}
+
+		if ((i + 1 == argc) || (strlen(argv[i]) != 2) || (argv[i][0] != '-'))
+			usage(argv[0]);
+
+		const long value = strtol(argv[++i], NULL, 0);
+
+		switch (argv[i - 1][1]) {
+		case 's': self.seconds = MAX(value, 1); break;
+		case 'r': self.seed = value; break;
+		case 'f': self.frq = MAX(0, MIN(value, 255)); break;
+		case 'h': self.hld = MAX(0, MIN(value, 255)); break;
+		case 'i': self.ind = MAX(0, MIN(value, 255)); break;
+		default: usage(argv[0]);
+		}
+	}
+
+	self.rng = self.seed ? self.seed : 1;
+
+	// what the SDK runtime sets up before main
+	clocks_init();
+	sim_flash_init();
+	sim_time_init();
+	sim_gpio_init();
+	sim_i2c_init();
+
+	return puppet_main();
+}
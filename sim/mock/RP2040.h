@@ -0,0 +1,3 @@
+#pragma once
+
+void NVIC_SystemReset(void);
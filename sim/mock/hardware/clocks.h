@@ -0,0 +1,31 @@
+#pragma once
+
+#include <pico.h>
+
+#define XOSC_MHZ			12
+
+enum clock_index
+{
+	clk_gpout0 = 0,
+	clk_gpout1,
+	clk_gpout2,
+	clk_gpout3,
+	clk_ref,
+	clk_sys,
+	clk_peri,
+	clk_usb,
+	clk_adc,
+	clk_rtc,
+	CLK_COUNT,
+};
+
+#define CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLK_REF				0x0
+#define CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX	0x1
+#define CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS		0x0
+#define CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB		0x1
+#define CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB	0x2
+
+void clocks_init(void);
+bool clock_configure(enum clock_index clk_index, uint32_t src, uint32_t auxsrc, uint32_t src_freq, uint32_t freq);
+void clock_stop(enum clock_index clk_index);
+uint32_t clock_get_hz(enum clock_index clk_index);
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <pico.h>
+
+#define GPIO_OUT			1
+#define GPIO_IN				0
+
+#define NUM_BANK0_GPIOS		30
+
+enum gpio_function
+{
+	GPIO_FUNC_I2C = 3,
+	GPIO_FUNC_PWM = 4,
+	GPIO_FUNC_SIO = 5,
+	GPIO_FUNC_NULL = 0x1f,
+};
+
+enum gpio_irq_level
+{
+	GPIO_IRQ_LEVEL_LOW = 0x1u,
+	GPIO_IRQ_LEVEL_HIGH = 0x2u,
+	GPIO_IRQ_EDGE_FALL = 0x4u,
+	GPIO_IRQ_EDGE_RISE = 0x8u,
+};
+
+typedef void (*gpio_irq_callback_t)(uint gpio, uint32_t event_mask);
+
+void gpio_init(uint gpio);
+void gpio_init_mask(uint gpio_mask);
+void gpio_set_function(uint gpio, enum gpio_function fn);
+
+void gpio_set_dir(uint gpio, bool out);
+void gpio_set_dir_masked(uint32_t mask, uint32_t value);
+
+void gpio_set_pulls(uint gpio, bool up, bool down);
+
+static inline void gpio_pull_up(uint gpio)
+{
+	gpio_set_pulls(gpio, true, false);
+}
+
+static inline void gpio_pull_down(uint gpio)
+{
+	gpio_set_pulls(gpio, false, true);
+}
+
+static inline void gpio_disable_pulls(uint gpio)
+{
+	gpio_set_pulls(gpio, false, false);
+}
+
+void gpio_put(uint gpio, bool value);
+void gpio_put_masked(uint32_t mask, uint32_t value);
+bool gpio_get(uint gpio);
+uint32_t gpio_get_all(void);
+
+// only edges are modelled, the levels never raise an irq
+void gpio_set_irq_enabled(uint gpio, uint32_t events, bool enabled);
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t events, bool enabled, gpio_irq_callback_t callback);
+void gpio_acknowledge_irq(uint gpio, uint32_t events);
+void gpio_set_dormant_irq_enabled(uint gpio, uint32_t events, bool enabled);
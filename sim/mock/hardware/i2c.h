@@ -0,0 +1,44 @@
+#pragma once
+
+#include <pico.h>
+
+#define I2C_IC_CON_RX_FIFO_FULL_HLD_CTRL_BITS	0x00000200u
+#define I2C_IC_INTR_MASK_M_RX_FULL_BITS		0x00000004u
+#define I2C_IC_INTR_MASK_M_RD_REQ_BITS		0x00000020u
+#define I2C_IC_STATUS_SLV_ACTIVITY_BITS		0x00000040u
+
+// only the registers the app touches. data_cmd holds the byte the irq is about to read, see sim_i2c.c
+typedef struct
+{
+	io_rw_32 con;
+	io_rw_32 intr_stat;
+	io_rw_32 intr_mask;
+	io_rw_32 data_cmd;
+	io_rw_32 clr_rd_req;
+	io_rw_32 status;
+	io_rw_32 enable;
+} i2c_hw_t;
+
+typedef struct i2c_inst
+{
+	i2c_hw_t *hw;
+} i2c_inst_t;
+
+extern i2c_inst_t i2c0_inst;
+extern i2c_inst_t i2c1_inst;
+
+#define i2c0				(&i2c0_inst)
+#define i2c1				(&i2c1_inst)
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate);
+uint i2c_set_baudrate(i2c_inst_t *i2c, uint baudrate);
+void i2c_set_slave_mode(i2c_inst_t *i2c, bool slave, uint8_t addr);
+
+static inline uint i2c_hw_index(i2c_inst_t *i2c)
+{
+	return (i2c == i2c1) ? 1 : 0;
+}
+
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop);
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop);
+void i2c_write_raw_blocking(i2c_inst_t *i2c, const uint8_t *src, size_t len);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <pico.h>
+
+#define TIMER_IRQ_0			0
+#define PWM_IRQ_WRAP		4
+#define USBCTRL_IRQ			5
+#define IO_IRQ_BANK0		13
+#define I2C0_IRQ			23
+#define I2C1_IRQ			24
+
+#define NUM_IRQS			32
+
+#define PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY	0x80
+#define PICO_SHARED_IRQ_HANDLER_LOWEST_ORDER_PRIORITY	0x00
+
+typedef void (*irq_handler_t)(void);
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority);
+void irq_set_enabled(uint num, bool enabled);
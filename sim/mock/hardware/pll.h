@@ -0,0 +1,23 @@
+#pragma once
+
+#include <pico.h>
+
+typedef struct pll_hw pll_hw_t;
+typedef pll_hw_t *PLL;
+
+#define pll_sys				((PLL)1)
+#define pll_usb				((PLL)2)
+
+static inline void pll_init(PLL pll, uint ref_div, uint vco_freq, uint post_div1, uint post_div2)
+{
+	(void)pll;
+	(void)ref_div;
+	(void)vco_freq;
+	(void)post_div1;
+	(void)post_div2;
+}
+
+static inline void pll_deinit(PLL pll)
+{
+	(void)pll;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <pico.h>
+
+// the PWM slices don't run in the sim, the outputs and the edge counters stay where they are
+
+#define PWM_CHAN_A			0
+#define PWM_CHAN_B			1
+
+enum pwm_clkdiv_mode
+{
+	PWM_DIV_FREE_RUNNING = 0,
+	PWM_DIV_B_HIGH,
+	PWM_DIV_B_RISING,
+	PWM_DIV_B_FALLING,
+};
+
+typedef struct
+{
+	uint32_t csr;
+	uint32_t div;
+	uint32_t top;
+} pwm_config;
+
+static inline uint pwm_gpio_to_slice_num(uint gpio)
+{
+	return (gpio >> 1u) & 7u;
+}
+
+static inline uint pwm_gpio_to_channel(uint gpio)
+{
+	return gpio & 1u;
+}
+
+static inline pwm_config pwm_get_default_config(void)
+{
+	return (pwm_config){ 0, 1 << 4, 0xffff };
+}
+
+static inline void pwm_config_set_clkdiv_mode(pwm_config *c, enum pwm_clkdiv_mode mode)
+{
+	c->csr = (uint32_t)mode << 4;
+}
+
+static inline void pwm_config_set_clkdiv_int(pwm_config *c, uint div)
+{
+	c->div = div << 4;
+}
+
+static inline void pwm_config_set_wrap(pwm_config *c, uint16_t wrap)
+{
+	c->top = wrap;
+}
+
+static inline void pwm_init(uint slice_num, pwm_config *c, bool start)
+{
+	(void)slice_num;
+	(void)c;
+	(void)start;
+}
+
+static inline void pwm_set_wrap(uint slice_num, uint16_t wrap)
+{
+	(void)slice_num;
+	(void)wrap;
+}
+
+static inline void pwm_set_clkdiv_int_frac(uint slice_num, uint8_t integer, uint8_t fract)
+{
+	(void)slice_num;
+	(void)integer;
+	(void)fract;
+}
+
+static inline void pwm_set_gpio_level(uint gpio, uint16_t level)
+{
+	(void)gpio;
+	(void)level;
+}
+
+static inline void pwm_set_enabled(uint slice_num, bool enabled)
+{
+	(void)slice_num;
+	(void)enabled;
+}
+
+static inline void pwm_set_counter(uint slice_num, uint16_t c)
+{
+	(void)slice_num;
+	(void)c;
+}
+
+static inline uint16_t pwm_get_counter(uint slice_num)
+{
+	(void)slice_num;
+
+	return 0;
+}
+
+static inline void pwm_set_irq_enabled(uint slice_num, bool enabled)
+{
+	(void)slice_num;
+	(void)enabled;
+}
+
+static inline void pwm_clear_irq(uint slice_num)
+{
+	(void)slice_num;
+}
+
+static inline uint32_t pwm_get_irq_status_mask(void)
+{
+	return 0;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <pico.h>
+
+// the irqs of the sim only run where the firmware could be interrupted: when they get enabled again, in the busy
+// waits and in __wfe
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+
+void sim_wfe(void);
+void sim_sev(void);
+
+#define __wfe()		sim_wfe()
+#define __sev()		sim_sev()
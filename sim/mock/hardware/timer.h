@@ -0,0 +1,9 @@
+#pragma once
+
+#include <pico.h>
+
+uint32_t time_us_32(void);
+uint64_t time_us_64(void);
+
+void busy_wait_us(uint64_t delay_us);
+void busy_wait_ms(uint32_t delay_ms);
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <pico.h>
+
+#ifndef PICO_DEFAULT_UART_BAUD_RATE
+#define PICO_DEFAULT_UART_BAUD_RATE	115200
+#endif
+
+typedef struct uart_inst uart_inst_t;
+
+#define uart_default		((uart_inst_t *)0)
+
+static inline uint uart_set_baudrate(uart_inst_t *uart, uint baudrate)
+{
+	(void)uart;
+
+	return baudrate;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <pico.h>
+
+// nothing stops in the sim, dormant mode returns right away as if a pin had woken it
+static inline void xosc_dormant(void)
+{
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+// Host stand-in for the parts of the pico-sdk the app uses, see sim/sim.h for what's behind it
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include PICO_BOARD_HEADER
+
+typedef unsigned int uint;
+
+typedef volatile uint32_t io_rw_32;
+typedef volatile const uint32_t io_ro_32;
+
+#ifndef MIN
+#define MIN(a, b)			((b) > (a) ? (a) : (b))
+#endif
+
+#ifndef MAX
+#define MAX(a, b)			((a) > (b) ? (a) : (b))
+#endif
+
+#define count_of(a)			(sizeof(a) / sizeof((a)[0]))
+
+#define KHZ					1000
+#define MHZ					1000000
+
+#define PICO_ERROR_GENERIC	-1
+
+// the flash is a plain array, see sim_flash.c
+extern uint8_t sim_flash[];
+#define XIP_BASE			((uintptr_t)sim_flash)
+
+static inline void hw_set_bits(io_rw_32 *addr, uint32_t mask)
+{
+	*addr |= mask;
+}
+
+static inline void hw_clear_bits(io_rw_32 *addr, uint32_t mask)
+{
+	*addr &= ~mask;
+}
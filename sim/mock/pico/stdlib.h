@@ -0,0 +1,10 @@
+#pragma once
+
+#include <pico.h>
+
+#include <hardware/gpio.h>
+#include <hardware/sync.h>
+#include <hardware/uart.h>
+#include <pico/time.h>
+
+bool check_sys_clock_khz(uint32_t freq_khz, uint *vco_freq_out, uint *post_div1_out, uint *post_div2_out);
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <pico.h>
+
+#include <hardware/timer.h>
+
+typedef uint64_t absolute_time_t;
+typedef int32_t alarm_id_t;
+
+// >0 to reschedule that many us from now, <0 that many us after the time it was due, 0 to stop
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void *user_data);
+
+absolute_time_t get_absolute_time(void);
+
+static inline uint32_t to_ms_since_boot(absolute_time_t t)
+{
+	return (uint32_t)(t / 1000);
+}
+
+void sleep_ms(uint32_t ms);
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void *user_data, bool fire_if_past);
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past);
+bool cancel_alarm(alarm_id_t alarm_id);
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <pico.h>
+#include <string.h>
+
+// the real one pulls these in through its pico OS abstraction
+#include <pico/stdlib.h>
+
+#include "tusb_config.h"
+
+// The device side of TinyUSB the app uses. The host the sim plays polls the HID endpoints at their bInterval and
+// takes every report, see sim_usb.c
+
+#define KEYBOARD_MODIFIER_LEFTSHIFT	(1 << 1)
+
+#define MOUSE_BUTTON_LEFT			(1 << 0)
+#define MOUSE_BUTTON_RIGHT			(1 << 1)
+#define MOUSE_BUTTON_MIDDLE			(1 << 2)
+
+#define HID_KEY_NONE			0x00
+#define HID_KEY_A				0x04
+#define HID_KEY_B				0x05
+#define HID_KEY_C				0x06
+#define HID_KEY_D				0x07
+#define HID_KEY_E				0x08
+#define HID_KEY_F				0x09
+#define HID_KEY_G				0x0A
+#define HID_KEY_H				0x0B
+#define HID_KEY_I				0x0C
+#define HID_KEY_J				0x0D
+#define HID_KEY_K				0x0E
+#define HID_KEY_L				0x0F
+#define HID_KEY_M				0x10
+#define HID_KEY_N				0x11
+#define HID_KEY_O				0x12
+#define HID_KEY_P				0x13
+#define HID_KEY_Q				0x14
+#define HID_KEY_R				0x15
+#define HID_KEY_S				0x16
+#define HID_KEY_T				0x17
+#define HID_KEY_U				0x18
+#define HID_KEY_V				0x19
+#define HID_KEY_W				0x1A
+#define HID_KEY_X				0x1B
+#define HID_KEY_Y				0x1C
+#define HID_KEY_Z				0x1D
+#define HID_KEY_1				0x1E
+#define HID_KEY_2				0x1F
+#define HID_KEY_3				0x20
+#define HID_KEY_4				0x21
+#define HID_KEY_5				0x22
+#define HID_KEY_6				0x23
+#define HID_KEY_7				0x24
+#define HID_KEY_8				0x25
+#define HID_KEY_9				0x26
+#define HID_KEY_0				0x27
+#define HID_KEY_ENTER			0x28
+#define HID_KEY_ESCAPE			0x29
+#define HID_KEY_BACKSPACE		0x2A
+#define HID_KEY_TAB				0x2B
+#define HID_KEY_SPACE			0x2C
+#define HID_KEY_MINUS			0x2D
+#define HID_KEY_EQUAL			0x2E
+#define HID_KEY_BRACKET_LEFT	0x2F
+#define HID_KEY_BRACKET_RIGHT	0x30
+#define HID_KEY_BACKSLASH		0x31
+#define HID_KEY_SEMICOLON		0x33
+#define HID_KEY_APOSTROPHE		0x34
+#define HID_KEY_GRAVE			0x35
+#define HID_KEY_COMMA			0x36
+#define HID_KEY_PERIOD			0x37
+#define HID_KEY_SLASH			0x38
+#define HID_KEY_DELETE			0x4C
+#define HID_KEY_ARROW_RIGHT		0x4F
+#define HID_KEY_ARROW_LEFT		0x50
+#define HID_KEY_ARROW_DOWN		0x51
+#define HID_KEY_ARROW_UP		0x52
+
+// { shift, keycode }, as in TinyUSB's hid.h
+#define HID_ASCII_TO_KEYCODE \
+	{ 0, HID_KEY_NONE }, /* 0x00 */ \
+	{ 0, HID_KEY_NONE }, /* 0x01 */ \
+	{ 0, HID_KEY_NONE }, /* 0x02 */ \
+	{ 0, HID_KEY_NONE }, /* 0x03 */ \
+	{ 0, HID_KEY_NONE }, /* 0x04 */ \
+	{ 0, HID_KEY_NONE }, /* 0x05 */ \
+	{ 0, HID_KEY_NONE }, /* 0x06 */ \
+	{ 0, HID_KEY_NONE }, /* 0x07 */ \
+	{ 0, HID_KEY_BACKSPACE }, /* 0x08 */ \
+	{ 0, HID_KEY_TAB }, /* 0x09 */ \
+	{ 0, HID_KEY_ENTER }, /* 0x0A */ \
+	{ 0, HID_KEY_NONE }, /* 0x0B */ \
+	{ 0, HID_KEY_NONE }, /* 0x0C */ \
+	{ 0, HID_KEY_ENTER }, /* 0x0D */ \
+	{ 0, HID_KEY_NONE }, /* 0x0E */ \
+	{ 0, HID_KEY_NONE }, /* 0x0F */ \
+	{ 0, HID_KEY_NONE }, /* 0x10 */ \
+	{ 0, HID_KEY_NONE }, /* 0x11 */ \
+	{ 0, HID_KEY_NONE }, /* 0x12 */ \
+	{ 0, HID_KEY_NONE }, /* 0x13 */ \
+	{ 0, HID_KEY_NONE }, /* 0x14 */ \
+	{ 0, HID_KEY_NONE }, /* 0x15 */ \
+	{ 0, HID_KEY_NONE }, /* 0x16 */ \
+	{ 0, HID_KEY_NONE }, /* 0x17 */ \
+	{ 0, HID_KEY_NONE }, /* 0x18 */ \
+	{ 0, HID_KEY_NONE }, /* 0x19 */ \
+	{ 0, HID_KEY_NONE }, /* 0x1A */ \
+	{ 0, HID_KEY_ESCAPE }, /* 0x1B */ \
+	{ 0, HID_KEY_NONE }, /* 0x1C */ \
+	{ 0, HID_KEY_NONE }, /* 0x1D */ \
+	{ 0, HID_KEY_NONE }, /* 0x1E */ \
+	{ 0, HID_KEY_NONE }, /* 0x1F */ \
+	{ 0, HID_KEY_SPACE }, /* 0x20 */ \
+	{ 1, HID_KEY_1 }, /* 0x21 */ \
+	{ 1, HID_KEY_APOSTROPHE }, /* 0x22 */ \
+	{ 1, HID_KEY_3 }, /* 0x23 */ \
+	{ 1, HID_KEY_4 }, /* 0x24 */ \
+	{ 1, HID_KEY_5 }, /* 0x25 */ \
+	{ 1, HID_KEY_7 }, /* 0x26 */ \
+	{ 0, HID_KEY_APOSTROPHE }, /* 0x27 */ \
+	{ 1, HID_KEY_9 }, /* 0x28 */ \
+	{ 1, HID_KEY_0 }, /* 0x29 */ \
+	{ 1, HID_KEY_8 }, /* 0x2A */ \
+	{ 1, HID_KEY_EQUAL }, /* 0x2B */ \
+	{ 0, HID_KEY_COMMA }, /* 0x2C */ \
+	{ 0, HID_KEY_MINUS }, /* 0x2D */ \
+	{ 0, HID_KEY_PERIOD }, /* 0x2E */ \
+	{ 0, HID_KEY_SLASH }, /* 0x2F */ \
+	{ 0, HID_KEY_0 }, /* 0x30 */ \
+	{ 0, HID_KEY_1 }, /* 0x31 */ \
+	{ 0, HID_KEY_2 }, /* 0x32 */ \
+	{ 0, HID_KEY_3 }, /* 0x33 */ \
+	{ 0, HID_KEY_4 }, /* 0x34 */ \
+	{ 0, HID_KEY_5 }, /* 0x35 */ \
+	{ 0, HID_KEY_6 }, /* 0x36 */ \
+	{ 0, HID_KEY_7 }, /* 0x37 */ \
+	{ 0, HID_KEY_8 }, /* 0x38 */ \
+	{ 0, HID_KEY_9 }, /* 0x39 */ \
+	{ 1, HID_KEY_SEMICOLON }, /* 0x3A */ \
+	{ 0, HID_KEY_SEMICOLON }, /* 0x3B */ \
+	{ 1, HID_KEY_COMMA }, /* 0x3C */ \
+	{ 0, HID_KEY_EQUAL }, /* 0x3D */ \
+	{ 1, HID_KEY_PERIOD }, /* 0x3E */ \
+	{ 1, HID_KEY_SLASH }, /* 0x3F */ \
+	{ 1, HID_KEY_2 }, /* 0x40 */ \
+	{ 1, HID_KEY_A }, /* 0x41 */ \
+	{ 1, HID_KEY_B }, /* 0x42 */ \
+	{ 1, HID_KEY_C }, /* 0x43 */ \
+	{ 1, HID_KEY_D }, /* 0x44 */ \
+	{ 1, HID_KEY_E }, /* 0x45 */ \
+	{ 1, HID_KEY_F }, /* 0x46 */ \
+	{ 1, HID_KEY_G }, /* 0x47 */ \
+	{ 1, HID_KEY_H }, /* 0x48 */ \
+	{ 1, HID_KEY_I }, /* 0x49 */ \
+	{ 1, HID_KEY_J }, /* 0x4A */ \
+	{ 1, HID_KEY_K }, /* 0x4B */ \
+	{ 1, HID_KEY_L }, /* 0x4C */ \
+	{ 1, HID_KEY_M }, /* 0x4D */ \
+	{ 1, HID_KEY_N }, /* 0x4E */ \
+	{ 1, HID_KEY_O }, /* 0x4F */ \
+	{ 1, HID_KEY_P }, /* 0x50 */ \
+	{ 1, HID_KEY_Q }, /* 0x51 */ \
+	{ 1, HID_KEY_R }, /* 0x52 */ \
+	{ 1, HID_KEY_S }, /* 0x53 */ \
+	{ 1, HID_KEY_T }, /* 0x54 */ \
+	{ 1, HID_KEY_U }, /* 0x55 */ \
+	{ 1, HID_KEY_V }, /* 0x56 */ \
+	{ 1, HID_KEY_W }, /* 0x57 */ \
+	{ 1, HID_KEY_X }, /* 0x58 */ \
+	{ 1, HID_KEY_Y }, /* 0x59 */ \
+	{ 1, HID_KEY_Z }, /* 0x5A */ \
+	{ 0, HID_KEY_BRACKET_LEFT }, /* 0x5B */ \
+	{ 0, HID_KEY_BACKSLASH }, /* 0x5C */ \
+	{ 0, HID_KEY_BRACKET_RIGHT }, /* 0x5D */ \
+	{ 1, HID_KEY_6 }, /* 0x5E */ \
+	{ 1, HID_KEY_MINUS }, /* 0x5F */ \
+	{ 0, HID_KEY_GRAVE }, /* 0x60 */ \
+	{ 0, HID_KEY_A }, /* 0x61 */ \
+	{ 0, HID_KEY_B }, /* 0x62 */ \
+	{ 0, HID_KEY_C }, /* 0x63 */ \
+	{ 0, HID_KEY_D }, /* 0x64 */ \
+	{ 0, HID_KEY_E }, /* 0x65 */ \
+	{ 0, HID_KEY_F }, /* 0x66 */ \
+	{ 0, HID_KEY_G }, /* 0x67 */ \
+	{ 0, HID_KEY_H }, /* 0x68 */ \
+	{ 0, HID_KEY_I }, /* 0x69 */ \
+	{ 0, HID_KEY_J }, /* 0x6A */ \
+	{ 0, HID_KEY_K }, /* 0x6B */ \
+	{ 0, HID_KEY_L }, /* 0x6C */ \
+	{ 0, HID_KEY_M }, /* 0x6D */ \
+	{ 0, HID_KEY_N }, /* 0x6E */ \
+	{ 0, HID_KEY_O }, /* 0x6F */ \
+	{ 0, HID_KEY_P }, /* 0x70 */ \
+	{ 0, HID_KEY_Q }, /* 0x71 */ \
+	{ 0, HID_KEY_R }, /* 0x72 */ \
+	{ 0, HID_KEY_S }, /* 0x73 */ \
+	{ 0, HID_KEY_T }, /* 0x74 */ \
+	{ 0, HID_KEY_U }, /* 0x75 */ \
+	{ 0, HID_KEY_V }, /* 0x76 */ \
+	{ 0, HID_KEY_W }, /* 0x77 */ \
+	{ 0, HID_KEY_X }, /* 0x78 */ \
+	{ 0, HID_KEY_Y }, /* 0x79 */ \
+	{ 0, HID_KEY_Z }, /* 0x7A */ \
+	{ 1, HID_KEY_BRACKET_LEFT }, /* 0x7B */ \
+	{ 1, HID_KEY_BACKSLASH }, /* 0x7C */ \
+	{ 1, HID_KEY_BRACKET_RIGHT }, /* 0x7D */ \
+	{ 1, HID_KEY_GRAVE }, /* 0x7E */ \
+	{ 0, HID_KEY_DELETE }  /* 0x7F */
+
+typedef enum
+{
+	HID_REPORT_TYPE_INVALID = 0,
+	HID_REPORT_TYPE_INPUT,
+	HID_REPORT_TYPE_OUTPUT,
+	HID_REPORT_TYPE_FEATURE,
+} hid_report_type_t;
+
+bool tusb_init(void);
+void tud_task(void);
+
+bool tud_mounted(void);
+bool tud_suspended(void);
+bool tud_ready(void);
+bool tud_connect(void);
+bool tud_disconnect(void);
+
+bool tud_hid_n_ready(uint8_t instance);
+bool tud_hid_n_report(uint8_t instance, uint8_t report_id, const void *report, uint16_t len);
+bool tud_hid_n_keyboard_report(uint8_t instance, uint8_t report_id, uint8_t modifier, const uint8_t keycode[6]);
+
+uint32_t tud_vendor_n_read(uint8_t itf, void *buffer, uint32_t bufsize);
+uint32_t tud_vendor_n_write(uint8_t itf, const void *buffer, uint32_t bufsize);
+uint32_t tud_vendor_n_write_available(uint8_t itf);
+
+// implemented by the app
+void tud_mount_cb(void);
+void tud_umount_cb(void);
+void tud_suspend_cb(bool remote_wakeup_en);
+void tud_resume_cb(void);
+uint16_t tud_hid_get_report_cb(uint8_t itf, uint8_t report_id, hid_report_type_t report_type, uint8_t *buffer, uint16_t reqlen);
+void tud_hid_set_report_cb(uint8_t itf, uint8_t report_id, hid_report_type_t report_type, const uint8_t *buffer, uint16_t bufsize);
+void tud_hid_report_complete_cb(uint8_t itf, const uint8_t *report, uint8_t len);
+void tud_vendor_rx_cb(uint8_t itf);
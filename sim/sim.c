@@ -0,0 +1,447 @@
+#include "sim.h"
+
+#include <RP2040.h>
+#include <ctype.h>
+#include <hardware/clocks.h>
+#include <pico/time.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fifo.h"
+#include "reg.h"
+
+#define MAX_LINE			256
+#define MAX_ARGS			16
+#define I2C_TIMEOUT_US		10000 // the firmware holds the clock, but not for longer than this
+
+static const uint8_t row_pins[NUM_OF_ROWS] = { PINS_ROWS };
+static const uint8_t col_pins[NUM_OF_COLS] = { PINS_COLS };
+static const uint8_t btn_pins[NUM_OF_BTNS] = { PINS_BTNS };
+static const uint8_t gpioexp_pins[NUM_OF_GPIOEXP] = { PINS_GPIOEXP };
+
+static const char * const state_names[] = { "idle", "pressed", "hold", "released" };
+
+// A script is one command per line, run in order. Only `wait` lets time pass, everything else happens at once,
+// with the main loop getting to run in between. `#` starts a comment.
+//
+//   wait <ms>
+//   key <row> <col> down|up                   close or open a switch of the matrix
+//   button <idx> down|up                      PINS_BTNS
+//   gpio <idx> high|low|float                 drive a PINS_GPIOEXP pin from outside
+//   touch <dx> <dy>                           motion on the trackpad
+//   i2c_write <reg> <value>
+//   i2c_read <reg> [<byte>...]                waits for the reply, and checks it if bytes are given
+//   expect fifo [<key> <state>...]            the whole REG_FIF contents, emptied afterwards
+//   expect reg <reg> <value>
+//   expect int <count>                        pulses on the INT pin since the last check
+//   expect hid key <modifier> [<keycode>...]  the next keyboard or mouse report the host got
+//   expect hid mouse <buttons> <x> <y> [<wheel> <pan>]
+//   expect hid none                           no report since the last check
+//   expect hid motion <x> <y>                 the sum of all the mouse reports since the last check
+//
+// Keys are a number or a character in quotes, like 'a'. A failed check is reported with its line, the exit code
+// is 1 if any failed and 2 if the script itself is broken.
+static struct
+{
+	const char *path;
+	FILE *file;
+	uint32_t line;
+
+	uint64_t next_us;	// when the next command runs
+
+	bool i2c_waiting;
+	uint64_t i2c_deadline_us;
+	uint8_t i2c_reg;
+	uint8_t i2c_expected[PACKET_OUT_MAX_LEN];
+	int i2c_expected_len; // -1 to only print the reply
+
+	uint32_t int_falls;
+
+	uint32_t checks;
+	uint32_t failures;
+} self;
+
+static void finish(void)
+{
+	printf("%s: %u checks, %u failed, %.3f ms\n", self.path, self.checks, self.failures, time_us_64() / 1000.0);
+
+	exit(self.failures ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+static void syntax_error(const char *what)
+{
+	fprintf(stderr, "%s:%u: %s\n", self.path, self.line, what);
+
+	exit(2);
+}
+
+static void check(bool ok, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void check(bool ok, const char *fmt, ...)
+{
+	++self.checks;
+
+	if (ok)
+		return;
+
+	++self.failures;
+
+	va_list args;
+	va_start(args, fmt);
+
+	printf("%s:%u: at %.3f ms: ", self.path, self.line, time_us_64() / 1000.0);
+	vprintf(fmt, args);
+	printf("\n");
+
+	va_end(args);
+}
+
+static long number(const char *arg)
+{
+	char *end;
+	const long value = strtol(arg, &end, 0);
+
+	if (!*arg || *end)
+		syntax_error("not a number");
+
+	return value;
+}
+
+static uint8_t key(const char *arg)
+{
+	if ((arg[0] == '\'') && arg[1] && (arg[2] == '\'') && !arg[3])
+		return (uint8_t)arg[1];
+
+	return (uint8_t)number(arg);
+}
+
+static enum key_state key_state(const char *arg)
+{
+	for (uint i = 0; i < count_of(state_names); ++i) {
+		if (!strcmp(arg, state_names[i]))
+			return i;
+	}
+
+	syntax_error("not a key state");
+	return KEY_STATE_IDLE;
+}
+
+static bool down(const char *arg)
+{
+	if (!strcmp(arg, "down"))
+		return true;
+
+	if (strcmp(arg, "up"))
+		syntax_error("expected down or up");
+
+	return false;
+}
+
+static uint index_arg(const char *arg, uint count)
+{
+	const long idx = number(arg);
+
+	if ((idx < 0) || (idx >= (long)count))
+		syntax_error("index out of range");
+
+	return idx;
+}
+
+// splits a line into its words, up to a `#` that isn't inside quotes
+static int split(char *line, char **args)
+{
+	int count = 0;
+	char *p = line;
+
+	while (*p) {
+		while (isspace((unsigned char)*p))
+			++p;
+
+		if (!*p || (*p == '#'))
+			break;
+
+		if (count == MAX_ARGS)
+			syntax_error("too many arguments");
+
+		args[count++] = p;
+
+		if (*p == '\'')
+			p += (p[1] ? 2 : 1);
+
+		while (*p && !isspace((unsigned char)*p))
+			++p;
+
+		if (*p)
+			*p++ = '\0';
+	}
+
+	return count;
+}
+
+static void expect_fifo(int argc, char **argv)
+{
+	if (argc % 2)
+		syntax_error("expected pairs of key and state");
+
+	const int expected = argc / 2;
+	const int count = fifo_count();
+	bool same = (count == expected);
+
+	char got[MAX_LINE] = "";
+	size_t len = 0;
+
+	for (int i = 0; i < count; ++i) {
+		const struct fifo_item item = fifo_dequeue();
+
+		if ((i < expected) && ((item.key != (char)key(argv[i * 2])) || (item.state != key_state(argv[i * 2 + 1]))))
+			same = false;
+
+		len += snprintf(&got[len], sizeof(got) - MIN(len, sizeof(got)), " 0x%02X %s", (uint8_t)item.key, state_names[item.state]);
+		len = MIN(len, sizeof(got) - 1);
+	}
+
+	check(same, "fifo has%s", count ? got : " nothing");
+}
+
+static void expect_hid(int argc, char **argv)
+{
+	if (argc < 1)
+		syntax_error("expected key, mouse or none");
+
+	struct sim_hid_report report;
+	const bool found = sim_usb_pop_report(&report);
+
+	if (!strcmp(argv[0], "none")) {
+		check(!found, "unexpected report on interface %u", found ? report.itf : 0);
+		return;
+	}
+
+	if (!strcmp(argv[0], "motion")) {
+		if (argc != 3)
+			syntax_error("expected x and y");
+
+		int32_t x = 0;
+		int32_t y = 0;
+
+		for (bool more = found; more; more = sim_usb_pop_report(&report)) {
+			int16_t value;
+
+			check(report.itf == USB_ITF_MOUSE, "report on interface %u", report.itf);
+
+			memcpy(&value, &report.data[1], sizeof(value));
+			x += value;
+			memcpy(&value, &report.data[3], sizeof(value));
+			y += value;
+		}
+
+		check((x == number(argv[1])) && (y == number(argv[2])), "motion %d %d", x, y);
+		return;
+	}
+
+	uint8_t expected[CFG_TUD_HID_EP_BUFSIZE] = { 0 };
+	uint8_t expected_len;
+	uint8_t itf;
+
+	if (!strcmp(argv[0], "key")) {
+		if ((argc < 2) || (argc > 8))
+			syntax_error("expected a modifier and up to 6 keycodes");
+
+		expected[0] = number(argv[1]);
+		for (int i = 2; i < argc; ++i)
+			expected[i] = number(argv[i]);
+
+		expected_len = 8;
+		itf = USB_ITF_KEYBOARD;
+	} else if (!strcmp(argv[0], "mouse")) {
+		if ((argc != 4) && (argc != 6))
+			syntax_error("expected buttons, x, y and optionally wheel and pan");
+
+		expected[0] = number(argv[1]);
+		for (int i = 2; i < argc; ++i) {
+			const int16_t value = number(argv[i]);
+			memcpy(&expected[1 + (i - 2) * 2], &value, sizeof(value));
+		}
+
+		expected_len = 9;
+		itf = USB_ITF_MOUSE;
+	} else {
+		syntax_error("expected key, mouse or none");
+		return;
+	}
+
+	if (!found) {
+		check(false, "no report");
+		return;
+	}
+
+	char got[MAX_LINE] = "";
+	for (uint8_t i = 0; i < report.len; ++i)
+		snprintf(&got[i * 3], sizeof(got) - i * 3, " %02X", report.data[i]);
+
+	check((report.itf == itf) && (report.len == expected_len) && !memcmp(report.data, expected, expected_len),
+		"report on interface %u:%s", report.itf, got);
+}
+
+static void expect(int argc, char **argv)
+{
+	if (argc < 1)
+		syntax_error("expected fifo, reg, int or hid");
+
+	if (!strcmp(argv[0], "fifo")) {
+		expect_fifo(argc - 1, &argv[1]);
+	} else if (!strcmp(argv[0], "reg") && (argc == 3)) {
+		const uint8_t value = reg_get_value(number(argv[1]));
+		check(value == number(argv[2]), "register 0x%02lX is 0x%02X", number(argv[1]), value);
+	} else if (!strcmp(argv[0], "int") && (argc == 2)) {
+		const uint32_t falls = sim_gpio_falls(PIN_INT) - self.int_falls;
+		self.int_falls += falls;
+		check(falls == (uint32_t)number(argv[1]), "%u INT pulses", falls);
+	} else if (!strcmp(argv[0], "hid")) {
+		expect_hid(argc - 1, &argv[1]);
+	} else {
+		syntax_error("bad expect");
+	}
+}
+
+static void i2c_read(int argc, char **argv)
+{
+	if ((argc < 1) || (argc > 1 + PACKET_OUT_MAX_LEN))
+		syntax_error("expected a register and up to 16 bytes");
+
+	self.i2c_reg = number(argv[0]);
+	self.i2c_expected_len = (argc > 1) ? (argc - 1) : -1;
+
+	for (int i = 1; i < argc; ++i)
+		self.i2c_expected[i - 1] = number(argv[i]);
+
+	self.i2c_waiting = true;
+	self.i2c_deadline_us = time_us_64() + I2C_TIMEOUT_US;
+
+	sim_i2c_read(self.i2c_reg);
+}
+
+static void i2c_done(const uint8_t *reply, uint8_t len)
+{
+	self.i2c_waiting = false;
+
+	char got[MAX_LINE] = "";
+	for (uint8_t i = 0; i < len; ++i)
+		snprintf(&got[i * 3], sizeof(got) - i * 3, " %02X", reply[i]);
+
+	if (self.i2c_expected_len < 0) {
+		printf("%s:%u: at %.3f ms: register 0x%02X:%s\n", self.path, self.line, time_us_64() / 1000.0, self.i2c_reg, got);
+		return;
+	}
+
+	check((len == self.i2c_expected_len) && !memcmp(reply, self.i2c_expected, len),
+		"register 0x%02X replied%s", self.i2c_reg, len ? got : " nothing");
+}
+
+static void run(int argc, char **argv)
+{
+	const char *cmd = argv[0];
+
+	if (!strcmp(cmd, "wait") && (argc == 2)) {
+		self.next_us = time_us_64() + number(argv[1]) * 1000;
+	} else if (!strcmp(cmd, "key") && (argc == 4)) {
+		sim_gpio_connect(row_pins[index_arg(argv[1], NUM_OF_ROWS)], col_pins[index_arg(argv[2], NUM_OF_COLS)], down(argv[3]));
+	} else if (!strcmp(cmd, "button") && (argc == 3)) {
+		sim_gpio_drive(btn_pins[index_arg(argv[1], NUM_OF_BTNS)], down(argv[2]) ? 0 : SIM_GPIO_FLOAT);
+	} else if (!strcmp(cmd, "gpio") && (argc == 3)) {
+		const uint pin = gpioexp_pins[index_arg(argv[1], NUM_OF_GPIOEXP)];
+
+		if (!strcmp(argv[2], "high"))
+			sim_gpio_drive(pin, 1);
+		else if (!strcmp(argv[2], "low"))
+			sim_gpio_drive(pin, 0);
+		else if (!strcmp(argv[2], "float"))
+			sim_gpio_drive(pin, SIM_GPIO_FLOAT);
+		else
+			syntax_error("expected high, low or float");
+	} else if (!strcmp(cmd, "touch") && (argc == 3)) {
+		sim_touch(number(argv[1]), number(argv[2]));
+	} else if (!strcmp(cmd, "i2c_write") && (argc == 3)) {
+		sim_i2c_write(number(argv[1]), number(argv[2]));
+	} else if (!strcmp(cmd, "i2c_read")) {
+		i2c_read(argc - 1, &argv[1]);
+	} else if (!strcmp(cmd, "expect")) {
+		expect(argc - 1, &argv[1]);
+	} else {
+		syntax_error("unknown command");
+	}
+}
+
+uint64_t sim_script_next(void)
+{
+	if (self.i2c_waiting) {
+		uint8_t reply[PACKET_OUT_MAX_LEN];
+		uint8_t len;
+
+		if (sim_i2c_take_reply(reply, &len)) {
+			i2c_done(reply, len);
+			return time_us_64();
+		}
+
+		return self.i2c_deadline_us;
+	}
+
+	return self.next_us;
+}
+
+// one command per call, the main loop runs in between
+void sim_script_run(void)
+{
+	if (self.i2c_waiting) {
+		// sim_script_next would have taken a reply
+		check(false, "no reply from register 0x%02X", self.i2c_reg);
+		self.i2c_waiting = false;
+		return;
+	}
+
+	char line[MAX_LINE];
+	char *args[MAX_ARGS];
+	int argc = 0;
+
+	while (!argc) {
+		if (!fgets(line, sizeof(line), self.file))
+			finish();
+
+		++self.line;
+		argc = split(line, args);
+	}
+
+	run(argc, args);
+}
+
+void NVIC_SystemReset(void)
+{
+	printf("%s:%u: at %.3f ms: reset\n", self.path, self.line, time_us_64() / 1000.0);
+
+	finish();
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s <script>\n", argv[0]);
+		return 2;
+	}
+
+	self.path = argv[1];
+	self.file = fopen(self.path, "r");
+	if (!self.file) {
+		perror(self.path);
+		return 2;
+	}
+
+	// what the SDK runtime sets up before main
+	clocks_init();
+	sim_flash_init();
+	sim_time_init();
+	sim_gpio_init();
+	sim_i2c_init();
+
+	return puppet_main();
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <pico.h>
+
+#include "tusb_config.h"
+
+// The firmware runs unchanged on one host thread. The irqs run wherever it could have been interrupted: when it
+// enables them again, in the busy waits and while the main loop waits for events in __wfe. The time only moves on
+// in those last two, so the firmware itself takes no time at all, and a run always plays out the same way.
+
+#define SIM_GPIO_FLOAT		-1
+
+struct sim_hid_report
+{
+	uint64_t time_us;	// when the firmware handed it over
+	uint64_t poll_us;	// when the host picked it up
+	uint8_t itf;
+	uint8_t len;
+	uint8_t data[CFG_TUD_HID_EP_BUFSIZE];
+};
+
+// sim_irq.c, an irq is raised once or asserted for as long as its source says so
+typedef bool (*sim_irq_source_t)(void);
+
+void sim_irq_raise(uint num);
+void sim_irq_set_source(uint num, sim_irq_source_t source);
+void sim_irq_dispatch(void);
+bool sim_irq_blocked(void);
+
+// sim_time.c
+void sim_time_init(void);
+void sim_run_until(uint64_t time_us);
+
+// sim_gpio.c, pins connected by a closed switch read the level of the one driven as output
+void sim_gpio_init(void);
+void sim_gpio_drive(uint gpio, int level);
+void sim_gpio_connect(uint gpio_a, uint gpio_b, bool closed);
+uint32_t sim_gpio_falls(uint gpio);
+
+// sim_i2c.c, the sim is the controller of the puppet I2C and the trackpad on the other bus
+void sim_i2c_init(void);
+void sim_i2c_write(uint8_t reg, uint8_t value);
+void sim_i2c_read(uint8_t reg);
+bool sim_i2c_take_reply(uint8_t *buffer, uint8_t *len);
+void sim_touch(int dx, int dy);
+
+// sim_usb.c, the reports the host got, oldest first
+bool sim_usb_pop_report(struct sim_hid_report *report);
+
+// sim_flash.c
+void sim_flash_init(void);
+
+// app/main.c, built under this name
+int puppet_main(void);
+
+// sim.c or bench.c, the stimulus runs from __wfe once the firmware has nothing left to do
+uint64_t sim_script_next(void);
+void sim_script_run(void);
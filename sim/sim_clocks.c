@@ -0,0 +1,50 @@
+#include "sim.h"
+
+#include <hardware/clocks.h>
+#include <pico/stdlib.h>
+
+// the clocks are only numbers here, the sim runs on the same time whatever they are set to
+static uint32_t clock_hz[CLK_COUNT];
+
+void clocks_init(void)
+{
+	clock_hz[clk_ref] = XOSC_MHZ * MHZ;
+	clock_hz[clk_sys] = 125 * MHZ;
+	clock_hz[clk_peri] = 125 * MHZ;
+	clock_hz[clk_usb] = 48 * MHZ;
+	clock_hz[clk_adc] = 48 * MHZ;
+	clock_hz[clk_rtc] = 46875;
+}
+
+bool clock_configure(enum clock_index clk_index, uint32_t src, uint32_t auxsrc, uint32_t src_freq, uint32_t freq)
+{
+	(void)src;
+	(void)auxsrc;
+
+	if (freq > src_freq)
+		return false;
+
+	clock_hz[clk_index] = freq;
+
+	return true;
+}
+
+void clock_stop(enum clock_index clk_index)
+{
+	clock_hz[clk_index] = 0;
+}
+
+uint32_t clock_get_hz(enum clock_index clk_index)
+{
+	return clock_hz[clk_index];
+}
+
+bool check_sys_clock_khz(uint32_t freq_khz, uint *vco_freq_out, uint *post_div1_out, uint *post_div2_out)
+{
+	// what the SDK picks for the default 125 MHz
+	*vco_freq_out = 1500 * MHZ;
+	*post_div1_out = 6;
+	*post_div2_out = 2;
+
+	return (freq_khz == 125000);
+}
@@ -0,0 +1,25 @@
+#include "sim.h"
+
+#include <hardware/flash.h>
+#include <string.h>
+
+#define FLASH_SIZE			(2 * 1024 * 1024)
+
+uint8_t sim_flash[FLASH_SIZE];
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+	memset(&sim_flash[flash_offs], 0xFF, count);
+}
+
+// programming can only clear bits, like on the chip
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+		sim_flash[flash_offs + i] &= data[i];
+}
+
+void sim_flash_init(void)
+{
+	memset(sim_flash, 0xFF, sizeof(sim_flash));
+}
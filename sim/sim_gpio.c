@@ -0,0 +1,228 @@
+#include "sim.h"
+
+#include <hardware/gpio.h>
+#include <hardware/irq.h>
+
+struct pin
+{
+	enum gpio_function func;
+	bool out;
+	bool value;
+	bool pull_up;
+	bool pull_down;
+	int drive;			// level forced from outside, or SIM_GPIO_FLOAT
+	bool level;
+	uint32_t irq_events;
+	uint32_t pending;
+	uint32_t falls;
+};
+
+static struct
+{
+	struct pin pins[NUM_BANK0_GPIOS];
+	bool switches[NUM_BANK0_GPIOS][NUM_BANK0_GPIOS];
+	gpio_irq_callback_t callback;
+} self;
+
+static bool level(uint gpio)
+{
+	const struct pin *pin = &self.pins[gpio];
+
+	if (pin->out)
+		return pin->value;
+
+	if (pin->drive != SIM_GPIO_FLOAT)
+		return pin->drive;
+
+	for (uint other = 0; other < NUM_BANK0_GPIOS; ++other) {
+		if (self.switches[gpio][other] && self.pins[other].out)
+			return self.pins[other].value;
+	}
+
+	// a floating input reads low
+	return pin->pull_up;
+}
+
+// picks up the edges of whatever the last change did
+static void update(void)
+{
+	for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; ++gpio) {
+		struct pin *pin = &self.pins[gpio];
+		const bool new_level = level(gpio);
+
+		if (new_level == pin->level)
+			continue;
+
+		pin->level = new_level;
+
+		const uint32_t event = new_level ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL;
+		if (!new_level)
+			++pin->falls;
+
+		if (pin->irq_events & event) {
+			pin->pending |= event;
+			sim_irq_raise(IO_IRQ_BANK0);
+		}
+	}
+}
+
+static void io_irq(void)
+{
+	for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; ++gpio) {
+		const uint32_t events = self.pins[gpio].pending;
+		if (!events)
+			continue;
+
+		self.pins[gpio].pending = 0;
+
+		if (self.callback)
+			self.callback(gpio, events);
+	}
+}
+
+void gpio_init(uint gpio)
+{
+	self.pins[gpio].out = false;
+	self.pins[gpio].value = false;
+	self.pins[gpio].func = GPIO_FUNC_SIO;
+
+	update();
+}
+
+void gpio_init_mask(uint gpio_mask)
+{
+	for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; ++gpio) {
+		if (gpio_mask & (1u << gpio))
+			gpio_init(gpio);
+	}
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn)
+{
+	self.pins[gpio].func = fn;
+}
+
+void gpio_set_dir(uint gpio, bool out)
+{
+	self.pins[gpio].out = out;
+
+	update();
+}
+
+void gpio_set_dir_masked(uint32_t mask, uint32_t value)
+{
+	for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; ++gpio) {
+		if (mask & (1u << gpio))
+			self.pins[gpio].out = (value & (1u << gpio));
+	}
+
+	update();
+}
+
+void gpio_set_pulls(uint gpio, bool up, bool down)
+{
+	self.pins[gpio].pull_up = up;
+	self.pins[gpio].pull_down = down;
+
+	update();
+}
+
+void gpio_put(uint gpio, bool value)
+{
+	self.pins[gpio].value = value;
+
+	update();
+}
+
+void gpio_put_masked(uint32_t mask, uint32_t value)
+{
+	for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; ++gpio) {
+		if (mask & (1u << gpio))
+			self.pins[gpio].value = (value & (1u << gpio));
+	}
+
+	update();
+}
+
+bool gpio_get(uint gpio)
+{
+	return level(gpio);
+}
+
+uint32_t gpio_get_all(void)
+{
+	uint32_t levels = 0;
+
+	for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; ++gpio) {
+		if (level(gpio))
+			levels |= (1u << gpio);
+	}
+
+	return levels;
+}
+
+void gpio_set_irq_enabled(uint gpio, uint32_t events, bool enabled)
+{
+	if (gpio >= NUM_BANK0_GPIOS)
+		return;
+
+	// as the SDK does, an edge from before enabling doesn't count
+	self.pins[gpio].pending &= ~events;
+
+	if (enabled)
+		self.pins[gpio].irq_events |= events;
+	else
+		self.pins[gpio].irq_events &= ~events;
+}
+
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t events, bool enabled, gpio_irq_callback_t callback)
+{
+	gpio_set_irq_enabled(gpio, events, enabled);
+
+	self.callback = callback;
+	irq_set_enabled(IO_IRQ_BANK0, true);
+}
+
+void gpio_acknowledge_irq(uint gpio, uint32_t events)
+{
+	self.pins[gpio].pending &= ~events;
+}
+
+void gpio_set_dormant_irq_enabled(uint gpio, uint32_t events, bool enabled)
+{
+	(void)gpio;
+	(void)events;
+	(void)enabled;
+}
+
+void sim_gpio_drive(uint gpio, int level)
+{
+	self.pins[gpio].drive = level;
+
+	update();
+}
+
+void sim_gpio_connect(uint gpio_a, uint gpio_b, bool closed)
+{
+	self.switches[gpio_a][gpio_b] = closed;
+	self.switches[gpio_b][gpio_a] = closed;
+
+	update();
+}
+
+uint32_t sim_gpio_falls(uint gpio)
+{
+	return self.pins[gpio].falls;
+}
+
+void sim_gpio_init(void)
+{
+	// out of reset every pin is an input with its pull-down on
+	for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; ++gpio) {
+		self.pins[gpio].func = GPIO_FUNC_NULL;
+		self.pins[gpio].pull_down = true;
+		self.pins[gpio].drive = SIM_GPIO_FLOAT;
+	}
+
+	irq_set_exclusive_handler(IO_IRQ_BANK0, io_irq);
+}
@@ -0,0 +1,221 @@
+#include "sim.h"
+
+#include <hardware/gpio.h>
+#include <hardware/i2c.h>
+#include <hardware/irq.h>
+#include <string.h>
+
+#include "reg.h"
+
+#define RX_SIZE				64
+
+#define TP_ADDR				0x3B
+#define TP_REG_MOTION		0x02
+#define TP_REG_DELTA_X		0x03
+#define TP_REG_DELTA_Y		0x04
+#define TP_MOTION_MOT		(1 << 7)
+
+static i2c_hw_t i2c_hw[2];
+
+i2c_inst_t i2c0_inst = { &i2c_hw[0] };
+i2c_inst_t i2c1_inst = { &i2c_hw[1] };
+
+static struct
+{
+	// the puppet side, the firmware is the target and the sim the controller
+	i2c_inst_t *slave;
+	uint8_t rx[RX_SIZE];
+	uint8_t rx_count;
+	bool rx_presented;	// rx[0] is in data_cmd, the irq read it
+	bool rd_req;
+
+	uint8_t reply[PACKET_OUT_MAX_LEN];
+	uint8_t reply_len;
+	bool reply_ready;
+
+	// the trackpad on the other bus, it keeps what didn't fit into one read
+	struct
+	{
+		uint8_t reg;
+		int dx;
+		int dy;
+	} tp;
+} self;
+
+static void update_status(void)
+{
+	if (self.rx_count || self.rd_req)
+		self.slave->hw->status |= I2C_IC_STATUS_SLV_ACTIVITY_BITS;
+	else
+		self.slave->hw->status &= ~I2C_IC_STATUS_SLV_ACTIVITY_BITS;
+}
+
+// one byte or read request per irq, like the RX_FULL and RD_REQ interrupts at a threshold of one byte
+static bool slave_asserted(void)
+{
+	i2c_hw_t *hw = self.slave->hw;
+
+	if (self.rx_presented) {
+		memmove(&self.rx[0], &self.rx[1], --self.rx_count);
+		self.rx_presented = false;
+	}
+
+	hw->intr_stat = 0;
+
+	if (self.rx_count && (hw->intr_mask & I2C_IC_INTR_MASK_M_RX_FULL_BITS)) {
+		hw->data_cmd = self.rx[0];
+		hw->intr_stat = I2C_IC_INTR_MASK_M_RX_FULL_BITS;
+		self.rx_presented = true;
+	} else if (!self.rx_count && self.rd_req && (hw->intr_mask & I2C_IC_INTR_MASK_M_RD_REQ_BITS)) {
+		hw->intr_stat = I2C_IC_INTR_MASK_M_RD_REQ_BITS;
+	}
+
+	update_status();
+
+	return hw->intr_stat;
+}
+
+static void push(uint8_t byte)
+{
+	if (self.rx_count >= RX_SIZE)
+		return;
+
+	self.rx[self.rx_count++] = byte;
+
+	update_status();
+	sim_irq_dispatch();
+}
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate)
+{
+	memset(i2c->hw, 0, sizeof(*i2c->hw));
+
+	return baudrate;
+}
+
+uint i2c_set_baudrate(i2c_inst_t *i2c, uint baudrate)
+{
+	(void)i2c;
+
+	return baudrate;
+}
+
+void i2c_set_slave_mode(i2c_inst_t *i2c, bool slave, uint8_t addr)
+{
+	(void)addr;
+
+	if (!slave)
+		return;
+
+	self.slave = i2c;
+	sim_irq_set_source(I2C0_IRQ + i2c_hw_index(i2c), slave_asserted);
+}
+
+void i2c_write_raw_blocking(i2c_inst_t *i2c, const uint8_t *src, size_t len)
+{
+	(void)i2c;
+
+	self.reply_len = MIN(len, sizeof(self.reply));
+	memcpy(self.reply, src, self.reply_len);
+	self.reply_ready = true;
+
+	self.rd_req = false;
+	update_status();
+}
+
+static uint8_t tp_read(uint8_t reg)
+{
+	int8_t value = 0;
+
+	switch (reg) {
+	case TP_REG_MOTION:
+		return (self.tp.dx || self.tp.dy) ? TP_MOTION_MOT : 0;
+
+	case TP_REG_DELTA_X:
+		value = MAX(-128, MIN(self.tp.dx, 127));
+		self.tp.dx -= value;
+		break;
+
+	case TP_REG_DELTA_Y:
+		value = MAX(-128, MIN(self.tp.dy, 127));
+		self.tp.dy -= value;
+
+		// the motion pin goes back up once the deltas are read, and down again if there's more
+		sim_gpio_drive(PIN_TP_MOTION, 1);
+		if (self.tp.dx || self.tp.dy)
+			sim_gpio_drive(PIN_TP_MOTION, 0);
+		break;
+	}
+
+	return (uint8_t)value;
+}
+
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop)
+{
+	(void)i2c;
+	(void)nostop;
+
+	if ((addr != TP_ADDR) || !len)
+		return PICO_ERROR_GENERIC;
+
+	self.tp.reg = src[0];
+
+	return len;
+}
+
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop)
+{
+	(void)i2c;
+	(void)nostop;
+
+	if (addr != TP_ADDR)
+		return PICO_ERROR_GENERIC;
+
+	for (size_t i = 0; i < len; ++i)
+		dst[i] = tp_read(self.tp.reg++);
+
+	return len;
+}
+
+void sim_i2c_write(uint8_t reg, uint8_t value)
+{
+	push(reg | PACKET_WRITE_MASK);
+	push(value);
+}
+
+void sim_i2c_read(uint8_t reg)
+{
+	self.reply_ready = false;
+
+	push(reg);
+
+	self.rd_req = true;
+	update_status();
+	sim_irq_dispatch();
+}
+
+bool sim_i2c_take_reply(uint8_t *buffer, uint8_t *len)
+{
+	if (!self.reply_ready)
+		return false;
+
+	memcpy(buffer, self.reply, self.reply_len);
+	*len = self.reply_len;
+	self.reply_ready = false;
+
+	return true;
+}
+
+void sim_touch(int dx, int dy)
+{
+	self.tp.dx += dx;
+	self.tp.dy += dy;
+
+	sim_gpio_drive(PIN_TP_MOTION, 0);
+}
+
+void sim_i2c_init(void)
+{
+	// the motion pin is open drain, it idles high
+	sim_gpio_drive(PIN_TP_MOTION, 1);
+}
@@ -0,0 +1,118 @@
+#include "sim.h"
+
+#include <hardware/irq.h>
+#include <hardware/sync.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_SHARED_HANDLERS	4
+
+static struct
+{
+	irq_handler_t handlers[NUM_IRQS][MAX_SHARED_HANDLERS];
+	sim_irq_source_t sources[NUM_IRQS];
+	uint32_t enabled;
+	uint32_t pending;
+
+	bool disabled;	// PRIMASK
+	bool in_irq;	// they all have the same priority, none interrupts another
+} self;
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler)
+{
+	self.handlers[num][0] = handler;
+}
+
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority)
+{
+	(void)order_priority;
+
+	for (uint i = 0; i < MAX_SHARED_HANDLERS; ++i) {
+		if (self.handlers[num][i])
+			continue;
+
+		self.handlers[num][i] = handler;
+		return;
+	}
+
+	fprintf(stderr, "sim: too many handlers for irq %u\n", num);
+	exit(EXIT_FAILURE);
+}
+
+void irq_set_enabled(uint num, bool enabled)
+{
+	if (enabled)
+		self.enabled |= (1u << num);
+	else
+		self.enabled &= ~(1u << num);
+
+	sim_irq_dispatch();
+}
+
+uint32_t save_and_disable_interrupts(void)
+{
+	const uint32_t status = self.disabled;
+
+	self.disabled = true;
+
+	return status;
+}
+
+void restore_interrupts(uint32_t status)
+{
+	self.disabled = status;
+
+	sim_irq_dispatch();
+}
+
+void sim_irq_raise(uint num)
+{
+	self.pending |= (1u << num);
+
+	sim_irq_dispatch();
+}
+
+void sim_irq_set_source(uint num, sim_irq_source_t source)
+{
+	self.sources[num] = source;
+}
+
+bool sim_irq_blocked(void)
+{
+	return self.disabled || self.in_irq;
+}
+
+static bool take_irq(uint num)
+{
+	if (!(self.enabled & (1u << num)))
+		return false;
+
+	if (self.pending & (1u << num)) {
+		self.pending &= ~(1u << num);
+		return true;
+	}
+
+	return self.sources[num] && self.sources[num]();
+}
+
+void sim_irq_dispatch(void)
+{
+	if (sim_irq_blocked())
+		return;
+
+	self.in_irq = true;
+
+	// lowest number first, as the NVIC would with equal priorities
+	for (uint num = 0; num < NUM_IRQS; ++num) {
+		if (!take_irq(num))
+			continue;
+
+		for (uint i = 0; (i < MAX_SHARED_HANDLERS) && self.handlers[num][i]; ++i)
+			self.handlers[num][i]();
+
+		// a handler may have raised another one
+		num = -1u;
+	}
+
+	self.in_irq = false;
+}
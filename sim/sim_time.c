@@ -0,0 +1,195 @@
+#include "sim.h"
+
+#include <hardware/irq.h>
+#include <hardware/sync.h>
+#include <pico/time.h>
+
+#define MAX_ALARMS			32
+
+struct alarm
+{
+	alarm_id_t id;		// 0 for a free slot
+	uint64_t time_us;
+	alarm_callback_t callback;
+	void *user_data;
+};
+
+static struct
+{
+	uint64_t now_us;
+
+	struct alarm alarms[MAX_ALARMS];
+	alarm_id_t last_id;
+
+	bool event;
+} self;
+
+static struct alarm *find_alarm(alarm_id_t id)
+{
+	for (uint i = 0; i < MAX_ALARMS; ++i) {
+		if (self.alarms[i].id == id)
+			return &self.alarms[i];
+	}
+
+	return NULL;
+}
+
+static struct alarm *next_alarm(void)
+{
+	struct alarm *next = NULL;
+
+	for (uint i = 0; i < MAX_ALARMS; ++i) {
+		if (!self.alarms[i].id)
+			continue;
+
+		if (!next || (self.alarms[i].time_us < next->time_us))
+			next = &self.alarms[i];
+	}
+
+	return next;
+}
+
+static bool timer_asserted(void)
+{
+	const struct alarm *alarm = next_alarm();
+
+	return alarm && (alarm->time_us <= self.now_us);
+}
+
+static void timer_irq(void)
+{
+	struct alarm *alarm;
+
+	while ((alarm = next_alarm()) && (alarm->time_us <= self.now_us)) {
+		const alarm_id_t id = alarm->id;
+		const uint64_t due_us = alarm->time_us;
+
+		const int64_t ret = alarm->callback(id, alarm->user_data);
+
+		// the callback may have cancelled it
+		alarm = find_alarm(id);
+		if (!alarm)
+			continue;
+
+		if (ret == 0)
+			alarm->id = 0;
+		else if (ret < 0)
+			alarm->time_us = due_us + (uint64_t)-ret;
+		else
+			alarm->time_us = self.now_us + (uint64_t)ret;
+	}
+}
+
+uint32_t time_us_32(void)
+{
+	return (uint32_t)self.now_us;
+}
+
+uint64_t time_us_64(void)
+{
+	return self.now_us;
+}
+
+absolute_time_t get_absolute_time(void)
+{
+	return self.now_us;
+}
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void *user_data, bool fire_if_past)
+{
+	(void)fire_if_past;
+
+	struct alarm *alarm = find_alarm(0);
+	if (!alarm)
+		return -1;
+
+	// ids are never reused, so cancelling one that already fired can't hit another
+	self.last_id = (self.last_id == INT32_MAX) ? 1 : (self.last_id + 1);
+
+	alarm->id = self.last_id;
+	alarm->time_us = self.now_us + us;
+	alarm->callback = callback;
+	alarm->user_data = user_data;
+
+	sim_irq_dispatch();
+
+	return alarm->id;
+}
+
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past)
+{
+	return add_alarm_in_us((uint64_t)ms * 1000, callback, user_data, fire_if_past);
+}
+
+bool cancel_alarm(alarm_id_t alarm_id)
+{
+	if (alarm_id <= 0)
+		return false;
+
+	struct alarm *alarm = find_alarm(alarm_id);
+	if (!alarm)
+		return false;
+
+	alarm->id = 0;
+
+	return true;
+}
+
+void sim_run_until(uint64_t time_us)
+{
+	// step from one alarm to the next, so each callback sees the time it was due at
+	const struct alarm *alarm;
+
+	while (!sim_irq_blocked() && (alarm = next_alarm()) && (alarm->time_us <= time_us)) {
+		self.now_us = MAX(self.now_us, alarm->time_us);
+		sim_irq_dispatch();
+	}
+
+	self.now_us = MAX(self.now_us, time_us);
+	sim_irq_dispatch();
+}
+
+void busy_wait_us(uint64_t delay_us)
+{
+	sim_run_until(self.now_us + delay_us);
+}
+
+void busy_wait_ms(uint32_t delay_ms)
+{
+	busy_wait_us((uint64_t)delay_ms * 1000);
+}
+
+void sleep_ms(uint32_t ms)
+{
+	busy_wait_ms(ms);
+}
+
+void sim_sev(void)
+{
+	self.event = true;
+}
+
+// the main loop has nothing to do, let the script have its turn or skip ahead to whatever happens next
+void sim_wfe(void)
+{
+	if (self.event) {
+		self.event = false;
+		return;
+	}
+
+	const uint64_t script_us = sim_script_next();
+	if (script_us <= self.now_us) {
+		sim_script_run();
+		return;
+	}
+
+	const struct alarm *alarm = next_alarm();
+	sim_run_until(alarm ? MIN(alarm->time_us, script_us) : script_us);
+}
+
+void sim_time_init(void)
+{
+	irq_set_exclusive_handler(TIMER_IRQ_0, timer_irq);
+	sim_irq_set_source(TIMER_IRQ_0, timer_asserted);
+	irq_set_enabled(TIMER_IRQ_0, true);
+}
@@ -0,0 +1,247 @@
+#include "sim.h"
+
+#include <hardware/irq.h>
+#include <pico/time.h>
+#include <string.h>
+#include <tusb.h>
+
+#define EVENT_QUEUE_SIZE	16
+#define REPORT_LOG_SIZE		64
+#define KEYBOARD_POLL_MS	10 // bInterval of the keyboard endpoint in usb_descriptors.c
+
+enum event
+{
+	EVENT_MOUNT,
+	EVENT_UMOUNT,
+	EVENT_REPORT_COMPLETE,
+};
+
+struct hid_itf
+{
+	bool busy;
+	uint8_t report[CFG_TUD_HID_EP_BUFSIZE];
+	uint8_t len;
+};
+
+// the host polls the endpoints on a fixed schedule and takes whatever report is waiting at the next poll
+static struct
+{
+	bool connected;
+	bool mounted;
+
+	struct
+	{
+		uint8_t items[EVENT_QUEUE_SIZE][2]; // event, interface
+		uint8_t count;
+		uint8_t read_idx;
+	} events;
+
+	struct hid_itf hid[CFG_TUD_HID];
+
+	struct
+	{
+		struct sim_hid_report items[REPORT_LOG_SIZE];
+		uint8_t count;
+		uint8_t read_idx;
+	} log;
+} self;
+
+static void post(enum event event, uint8_t itf)
+{
+	if (self.events.count >= EVENT_QUEUE_SIZE)
+		return;
+
+	uint8_t *item = self.events.items[(self.events.read_idx + self.events.count) % EVENT_QUEUE_SIZE];
+	item[0] = event;
+	item[1] = itf;
+	++self.events.count;
+
+	sim_irq_raise(USBCTRL_IRQ);
+}
+
+static uint32_t poll_ms(uint8_t itf)
+{
+	return (itf == USB_ITF_MOUSE) ? USB_MOUSE_POLL_MS : KEYBOARD_POLL_MS;
+}
+
+static int64_t poll_task(alarm_id_t id, void *user_data)
+{
+	(void)id;
+
+	const uint8_t itf = (uintptr_t)user_data;
+
+	self.hid[itf].busy = false;
+
+	post(EVENT_REPORT_COMPLETE, itf);
+
+	return 0;
+}
+
+static void log_report(uint8_t itf, uint64_t poll_us)
+{
+	if (self.log.count >= REPORT_LOG_SIZE)
+		self.log.read_idx = (self.log.read_idx + 1) % REPORT_LOG_SIZE;
+	else
+		++self.log.count;
+
+	struct sim_hid_report *report = &self.log.items[(self.log.read_idx + self.log.count - 1) % REPORT_LOG_SIZE];
+
+	report->time_us = time_us_64();
+	report->poll_us = poll_us;
+	report->itf = itf;
+	report->len = self.hid[itf].len;
+	memcpy(report->data, self.hid[itf].report, self.hid[itf].len);
+}
+
+static bool send(uint8_t itf, const void *data, uint16_t len)
+{
+	if (!tud_hid_n_ready(itf) || (len > CFG_TUD_HID_EP_BUFSIZE))
+		return false;
+
+	memcpy(self.hid[itf].report, data, len);
+	self.hid[itf].len = len;
+	self.hid[itf].busy = true;
+
+	// the next poll of the endpoint, on the frame grid
+	const uint64_t interval_us = poll_ms(itf) * 1000;
+	const uint64_t poll_us = (time_us_64() / interval_us + 1) * interval_us;
+
+	log_report(itf, poll_us);
+
+	add_alarm_in_us(poll_us - time_us_64(), poll_task, (void *)(uintptr_t)itf, true);
+
+	return true;
+}
+
+bool tusb_init(void)
+{
+	irq_set_enabled(USBCTRL_IRQ, true);
+
+	tud_connect();
+
+	return true;
+}
+
+void tud_task(void)
+{
+	while (self.events.count) {
+		const uint8_t *item = self.events.items[self.events.read_idx];
+		const enum event event = item[0];
+		const uint8_t itf = item[1];
+
+		self.events.read_idx = (self.events.read_idx + 1) % EVENT_QUEUE_SIZE;
+		--self.events.count;
+
+		switch (event) {
+		case EVENT_MOUNT:
+			self.mounted = true;
+			tud_mount_cb();
+			break;
+
+		case EVENT_UMOUNT:
+			self.mounted = false;
+			memset(self.hid, 0, sizeof(self.hid));
+			tud_umount_cb();
+			break;
+
+		case EVENT_REPORT_COMPLETE:
+			tud_hid_report_complete_cb(itf, self.hid[itf].report, self.hid[itf].len);
+			break;
+		}
+	}
+}
+
+bool tud_mounted(void)
+{
+	return self.mounted;
+}
+
+bool tud_suspended(void)
+{
+	return false;
+}
+
+bool tud_ready(void)
+{
+	return self.mounted;
+}
+
+bool tud_connect(void)
+{
+	if (!self.connected) {
+		self.connected = true;
+		post(EVENT_MOUNT, 0);
+	}
+
+	return true;
+}
+
+bool tud_disconnect(void)
+{
+	if (self.connected) {
+		self.connected = false;
+		post(EVENT_UMOUNT, 0);
+	}
+
+	return true;
+}
+
+bool tud_hid_n_ready(uint8_t instance)
+{
+	return tud_ready() && (instance < CFG_TUD_HID) && !self.hid[instance].busy;
+}
+
+bool tud_hid_n_report(uint8_t instance, uint8_t report_id, const void *report, uint16_t len)
+{
+	(void)report_id;
+
+	return send(instance, report, len);
+}
+
+bool tud_hid_n_keyboard_report(uint8_t instance, uint8_t report_id, uint8_t modifier, const uint8_t keycode[6])
+{
+	(void)report_id;
+
+	uint8_t report[8] = { modifier, 0 };
+
+	if (keycode)
+		memcpy(&report[2], keycode, 6);
+
+	return send(instance, report, sizeof(report));
+}
+
+uint32_t tud_vendor_n_read(uint8_t itf, void *buffer, uint32_t bufsize)
+{
+	(void)itf;
+	(void)buffer;
+	(void)bufsize;
+
+	return 0;
+}
+
+uint32_t tud_vendor_n_write(uint8_t itf, const void *buffer, uint32_t bufsize)
+{
+	(void)itf;
+	(void)buffer;
+
+	return bufsize;
+}
+
+uint32_t tud_vendor_n_write_available(uint8_t itf)
+{
+	(void)itf;
+
+	return CFG_TUD_VENDOR_TX_BUFSIZE;
+}
+
+bool sim_usb_pop_report(struct sim_hid_report *report)
+{
+	if (!self.log.count)
+		return false;
+
+	*report = self.log.items[self.log.read_idx];
+	self.log.read_idx = (self.log.read_idx + 1) % REPORT_LOG_SIZE;
+	--self.log.count;
+
+	return true;
+}